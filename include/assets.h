@@ -0,0 +1,31 @@
+#pragma once
+
+#include "base.h"
+
+struct SDL_RWops;
+
+/*
+ * Game assets (fonts/, audio/, img/) are packed into the executable at build
+ * time by tools/pack_assets.sh, so the game runs from any working directory
+ * and never touches the filesystem for resources.
+ */
+struct Asset
+{
+    const char* path; // Path relative to the repository root e.g. "fonts/DejaVuSansMono.ttf"
+    const unsigned char* data;
+    size_t size;
+};
+
+// Defined in the generated asset pack
+extern const Asset g_assets[];
+extern const size_t g_numAssets;
+
+// Returns nullptr if no asset was packed under the given path
+const Asset* findAsset(const std::string& path);
+
+/*
+ * Read-only SDL_RWops over the packed bytes, no copy is made. Pass freesrc = 1
+ * to the SDL loader (TTF_OpenFontRW, Mix_LoadWAV_RW, ...) so it closes the
+ * RWops. Returns nullptr and sets the SDL error if the asset does not exist.
+ */
+SDL_RWops* openAsset(const std::string& path);
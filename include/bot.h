@@ -0,0 +1,14 @@
+#pragma once
+
+#include "shrinky.h"
+
+/*
+ * Greedy bot: drains its cell when it is full, otherwise takes one step
+ * towards the nearest full cell. Decides purely from a published snapshot, so
+ * it can run on any thread.
+ *
+ * fullCells is the list of full cells in snapshot, gathered once per snapshot
+ * by the caller rather than once per bot. Returns false if there is nothing
+ * worth doing.
+ */
+bool chooseBotAction(const GameSnapshot& snapshot, const std::vector<GridPosition>& fullCells, size_t agent, PlayerAction& out);
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "base.h"
+
+#include <atomic>
+
+/*
+ * Lock-free triple buffer for handing the latest value of T from exactly one
+ * writer thread to exactly one reader thread.
+ *
+ * The writer fills writeBuffer() and calls publish(), the reader calls fetch()
+ * and then reads readBuffer(). Neither side ever blocks or waits on the other:
+ * the writer always has a free buffer to fill and the reader always sees the
+ * newest published value, intermediate values are simply skipped. Buffers are
+ * reused, so a T holding vectors only allocates on the first few publishes.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+    // Writer side
+    T& writeBuffer()
+    {
+        return m_buffers[m_writeIdx];
+    }
+
+    void publish()
+    {
+        // Swap our filled buffer into the middle slot and take whatever was there
+        uint8_t previous = m_middle.exchange(m_writeIdx | NEW_DATA, std::memory_order_acq_rel);
+        m_writeIdx = previous & INDEX_MASK;
+    }
+
+    // Reader side. Returns true if readBuffer() changed.
+    bool fetch()
+    {
+        if ((m_middle.load(std::memory_order_relaxed) & NEW_DATA) == 0)
+            return false;
+
+        uint8_t previous = m_middle.exchange(m_readIdx, std::memory_order_acq_rel);
+        m_readIdx = previous & INDEX_MASK;
+        return true;
+    }
+
+    const T& readBuffer() const
+    {
+        return m_buffers[m_readIdx];
+    }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t NEW_DATA = 0x4;
+
+    T m_buffers[3];
+    uint8_t m_writeIdx{ 0 };              // Only touched by the writer
+    std::atomic<uint8_t> m_middle{ 1 };   // Index of the hand-off buffer plus NEW_DATA flag
+    uint8_t m_readIdx{ 2 };               // Only touched by the reader
+};
+
+/*
+ * Bounded lock-free multiple producer, single consumer queue (Vyukov's
+ * sequence-per-slot ring). Any number of threads may push(), exactly one
+ * thread may pop(). Capacity must be a power of two. push() fails instead of
+ * blocking when full.
+ */
+template <typename T, size_t Capacity>
+class MpscQueue
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    MpscQueue()
+    {
+        for (size_t i = 0; i < Capacity; i++)
+        {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool push(const T& value)
+    {
+        Slot* slot;
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        while (true)
+        {
+            slot = &m_slots[tail & (Capacity - 1)];
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(tail);
+
+            if (diff == 0)
+            {
+                // Slot is free, claim it by advancing the tail
+                if (m_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false; // Full
+            }
+            else
+            {
+                tail = m_tail.load(std::memory_order_relaxed); // Another producer got here first
+            }
+        }
+
+        slot->value = value;
+        slot->sequence.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& out)
+    {
+        Slot& slot = m_slots[m_head & (Capacity - 1)];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence != m_head + 1)
+            return false; // Empty, or the producer has not finished writing yet
+
+        out = slot.value;
+        slot.sequence.store(m_head + Capacity, std::memory_order_release);
+        m_head++;
+        return true;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    Slot m_slots[Capacity];
+    alignas(64) std::atomic<size_t> m_tail{ 0 }; // Shared by producers
+    alignas(64) size_t m_head{ 0 };              // Only touched by the consumer
+};
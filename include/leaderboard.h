@@ -0,0 +1,115 @@
+#pragma once
+
+#include "base.h"
+
+#include <memory>
+
+/*
+ * One finished game. Fixed size so records can be appended to and read
+ * straight out of the mapped file.
+ */
+struct SessionRecord
+{
+    int64_t score{ 0 };
+    uint64_t duration_ms{ 0 };  // Game time, not wall time
+    uint64_t configHash{ 0 };   // GameConfigurations::hash() of the rules it was played under
+    uint64_t seed{ 0 };
+    uint64_t finishedAt{ 0 };   // Unix time in seconds
+    uint8_t strikes{ 0 };
+    uint8_t reserved[3]{};
+    uint32_t checksum{ 0 };     // Filled in by Leaderboard::append()
+};
+
+struct LeaderboardEntry
+{
+    int64_t score;
+    uint64_t record; // Index into the record file
+};
+
+// Running totals over every session ever played under one config, survive compaction
+struct ConfigAggregate
+{
+    uint64_t configHash;
+    uint64_t sessions;
+    int64_t totalScore;
+    int64_t bestScore;
+    uint64_t totalDuration_ms;
+    uint64_t totalStrikes;
+};
+
+/*
+ * Append-only, memory-mapped file of finished sessions with a maintained top-K
+ * index and per-config aggregates.
+ *
+ * File layout: two header slots followed by fixed size SessionRecords. Each
+ * header holds the committed record count, the top-K index and the aggregates,
+ * and is checksummed. A commit writes the record past the committed end and
+ * syncs it, then writes the updated header into the slot that is not current
+ * with a higher sequence number and syncs that. A crash at any point leaves
+ * the last good header intact, and a half written record beyond its committed
+ * count is simply overwritten by the next append. Opening only validates the
+ * newest header, so the leaderboard is available without reading any records
+ * however many there are.
+ *
+ * Several processes may have the same file open. Writers take an exclusive
+ * flock and re-read the newest header under it, so each append lands after
+ * every other process's. Compaction replaces the file, so a writer whose path
+ * now names a different file switches to that one before writing.
+ */
+class Leaderboard
+{
+public:
+    static constexpr const size_t TOP_K = 100;
+    static constexpr const size_t MAX_CONFIGS = 128; // Configs past this are recorded but not aggregated
+
+    Leaderboard();
+    ~Leaderboard();
+
+    Leaderboard(const Leaderboard&) = delete;
+    Leaderboard& operator=(const Leaderboard&) = delete;
+
+    bool open(const std::string& path); // Creates the file if it does not exist, fails without touching a file that is not a leaderboard of this version
+    void close();
+    bool isOpen();
+
+    bool append(SessionRecord record); // Durable on disk once this returns true
+
+    size_t size(); // Committed records
+    const SessionRecord& record(size_t index);
+
+    size_t topCount();
+    const LeaderboardEntry& top(size_t rank); // 0 is the best score
+    size_t rankOf(uint64_t record); // TOP_K if the record is not in the top-K
+    const ConfigAggregate* aggregate(uint64_t configHash); // nullptr if never played
+    size_t aggregateCount();
+    const ConfigAggregate& aggregateAt(size_t index);
+
+    /*
+     * Rewrites the file keeping only the top-K records and the newest
+     * keepRecent, then reopens it. Aggregates are carried over unchanged.
+     * The rewrite goes through a temporary file and a rename, so a crash
+     * leaves either the old file or the new one.
+     */
+    bool compact(size_t keepRecent);
+
+    struct Header; // On-disk header layout, defined in leaderboard.cpp
+
+private:
+    bool lockFile(); // Locks the file currently at m_path, reopening it if it was replaced
+    void unlockFile();
+    bool loadHeader(); // Must hold the lock, picks up commits made by other processes
+    bool rewrite(size_t keepRecent);
+    bool map(size_t capacity);
+    bool grow();
+    bool commitHeader();
+    bool rebuildIndex(); // Recovers from two bad headers by scanning the records
+    static void addToIndex(Header& header, const SessionRecord& record, uint64_t index);
+
+    std::string m_path;
+    int m_fd{ -1 };
+    uint8_t* m_map{ nullptr };
+    size_t m_mapSize{ 0 };
+    size_t m_capacity{ 0 };   // Records the mapping has room for
+    std::unique_ptr<Header> m_header; // Working copy of the current header
+    int m_currentSlot{ 0 };
+};
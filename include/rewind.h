@@ -0,0 +1,97 @@
+#pragma once
+
+#include "base.h"
+
+/*
+ * Ring buffer of serialized GameStates taken every snapshotInterval ticks.
+ *
+ * Each entry is stored as the XOR of its bytes against the previous entry,
+ * run length encoded. Consecutive states differ only in the few cells that are
+ * draining and a handful of counters, so an entry is a small fraction of a
+ * full state even on large grids. Every keyframeInterval entries the delta is
+ * taken against nothing instead, which bounds how many deltas are applied to
+ * reconstruct any entry and keeps seek() constant time.
+ */
+class RewindBuffer
+{
+public:
+    RewindBuffer(size_t capacity, uint64_t snapshotInterval, size_t keyframeInterval = 32);
+
+    // Ticks must be multiples of snapshotInterval and increase between calls
+    void push(uint64_t tick, const std::vector<uint8_t>& state);
+
+    /*
+     * Reconstructs the state from the given number of snapshots ago and drops
+     * everything newer, so play continues from there. Stops at the oldest
+     * snapshot if asked to go further back. Returns false if the buffer is empty.
+     */
+    bool rewind(size_t steps, std::vector<uint8_t>& out);
+
+    // Reconstructs the newest snapshot taken at or before tick without modifying the buffer
+    bool seek(uint64_t tick, std::vector<uint8_t>& out);
+
+    size_t size();
+    size_t memoryUsage(); // Bytes of encoded deltas held
+
+private:
+    struct Entry
+    {
+        uint64_t tick{ 0 };
+        bool keyframe{ false };
+        size_t stateSize{ 0 };
+        std::vector<uint8_t> delta;
+    };
+
+    Entry& entryAt(size_t index); // 0 is the oldest entry
+    void reconstruct(size_t index, std::vector<uint8_t>& out);
+
+    static void encodeDelta(const std::vector<uint8_t>& base, const std::vector<uint8_t>& state, std::vector<uint8_t>& out);
+    static void applyDelta(const std::vector<uint8_t>& delta, size_t stateSize, std::vector<uint8_t>& inOut);
+
+    std::vector<Entry> m_entries;
+    size_t m_oldest{ 0 };
+    size_t m_count{ 0 };
+    uint64_t m_snapshotInterval;
+    size_t m_keyframeInterval;
+    size_t m_sinceKeyframe{ 0 };
+    std::vector<uint8_t> m_newest; // Decoded newest entry, the base for the next push
+    std::vector<uint8_t> m_scratch;
+};
+
+/*
+ * Crash-safe save file helpers. The new contents are written to a temporary
+ * file, flushed to disk and then renamed over the old save, so a crash at any
+ * point leaves either the previous save or the new one, never a torn file.
+ */
+bool writeSaveFile(const std::string& path, const std::vector<uint8_t>& bytes);
+bool readSaveFile(const std::string& path, std::vector<uint8_t>& out);
+
+/*
+ * Writes saves on a background thread so the fsync in writeSaveFile never
+ * stalls the caller. Only the latest submitted save is kept: a submit while a
+ * write is in progress replaces any save still waiting rather than queueing
+ * behind it.
+ */
+class SaveWriter
+{
+public:
+    SaveWriter(const std::string& path);
+    ~SaveWriter();
+
+    // Takes the contents of bytes and leaves it holding a spare buffer
+    void submit(std::vector<uint8_t>& bytes);
+
+    // Finishes the write in progress, drops any waiting save and stops the thread
+    void stop();
+
+private:
+    void run();
+
+    std::string m_path;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::vector<uint8_t> m_pending;
+    bool m_hasPending{ false };
+    bool m_stopping{ false };
+    std::thread m_thread;
+};
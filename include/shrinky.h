@@ -1,11 +1,12 @@
 #pragma once
 
-#include "utils.h"
+#include "base.h"
 
 static constexpr const uint32_t WINDOW_HEIGHT = 720;
 static constexpr const uint32_t WINDOW_WIDTH = 1280;
+static constexpr const uint8_t MAX_STRIKES = 3;
 
-static struct GameConfigurations {
+struct GameConfigurations {
     // Grid dimensions configurations
     uint32_t gridHeight_cells = 4;
     uint32_t gridWidth_cells = 4;
@@ -26,7 +27,15 @@ static struct GameConfigurations {
     float drainRateDeltaPeriod_ms = 1000;
     float drainRateMax = 1.0;
     float drainRateVariation = 0.1;
-} config;
+
+    // Also recomputes the cell pixel sizes. Call before creating a Game.
+    void setGridSize(uint32_t width, uint32_t height);
+
+    // Identifies the rules a session was played under, for comparing scores on the leaderboard
+    uint64_t hash(size_t numAgents) const;
+};
+
+extern GameConfigurations config; // Shared by every translation unit, defined in shrinky.cpp
 
 enum class PlayerMove
 {
@@ -36,6 +45,17 @@ enum class PlayerMove
     RIGHT
 };
 
+// Everything a player or bot can ask the simulation to do, forwarded through its agent's command queue
+enum class PlayerAction
+{
+    MOVE_UP,
+    MOVE_DOWN,
+    MOVE_LEFT,
+    MOVE_RIGHT,
+    DRAIN,
+    REWIND // Practice mode only, handled by the simulation loop rather than Game
+};
+
 struct GridPosition
 {
     GridPosition(int8_t initialRow, int8_t initialCol)
@@ -64,6 +84,71 @@ struct GridPosition
     int8_t col;
 };
 
+/*
+ * Immutable copy of everything needed to draw a frame, published by the
+ * simulation thread and consumed by the render thread
+ */
+struct GameSnapshot
+{
+    uint8_t gridWidth{ 0 };
+    uint8_t gridHeight{ 0 };
+    std::vector<float> cellFullness; // Row major, gridHeight * gridWidth
+    std::vector<GridPosition> drainerPositions; // Indexed by agent, agent 0 is the local player
+    std::vector<int64_t> agentScores;
+    int64_t score{ 0 }; // Total of all agents
+    uint8_t strikes{ 0 };
+    bool gameOver{ false };
+};
+
+struct CellState
+{
+    float proportionFilled;
+    float shrinkRate;
+};
+
+// A successful drain, remembered for a short while so a near simultaneous drain of the same cell counts as contested
+struct RecentDrain
+{
+    GridPosition position;
+    uint32_t agent;
+    float time_ms; // Game time of the tick it was resolved in
+};
+
+/*
+ * Complete, serializable state of a game. Restoring one with Game::load()
+ * continues the game exactly as it would have from the point it was saved.
+ */
+struct GameState
+{
+    uint64_t tick{ 0 };
+    uint32_t seed{ 0 }; // The game was started with, rngState has moved on from it
+    uint32_t rngState{ 0 };
+    bool practice{ false }; // Set once any part of the game was played in practice mode
+    std::vector<GridPosition> drainerPositions;
+    std::vector<int64_t> agentScores;
+    int64_t score{ 0 };
+    uint8_t strikes{ 0 };
+
+    // Timers driving the difficulty ramp and cell fills
+    float totalTimeElapsed_ms{ 0.0f };
+    float lastFillTime_ms{ 0.0f };
+    float lastFillPeriodUpdate_ms{ 0.0f };
+    float lastDrainRatePeriodUpdate_ms{ 0.0f };
+
+    // Difficulty values, these start at their config values and ramp over time
+    float fillInterval_ms{ 0.0f };
+    float drainRate{ 0.0f };
+
+    uint8_t gridWidth{ 0 };
+    uint8_t gridHeight{ 0 };
+    std::vector<CellState> cells; // Row major, gridHeight * gridWidth
+    std::vector<GridPosition> availableCells; // Order matters, it decides which cell fills next
+    std::vector<RecentDrain> recentDrains;
+
+    void serialize(std::vector<uint8_t>& out) const;
+    bool deserialize(const std::vector<uint8_t>& in); // Returns false if the bytes are not a valid state
+};
+
 /*
  * Class to track position of player, the "Drainer", on grid
  */
@@ -73,6 +158,7 @@ public:
     Drainer(int8_t initialRow, int8_t initialCol, int8_t gridWidth, int8_t gridHeight);
     void move(PlayerMove move); // TODO: wrap around?? 
     GridPosition position();
+    void setPosition(GridPosition position);
 
 private:
     GridPosition m_position;
@@ -99,27 +185,35 @@ public:
     void drain();
     void update(float dt); // Shrink based on shrinkRate
 
+    CellState state();
+    void restore(const CellState& state);
+
 private:
     float m_shrinkRate{ 0.0f };
     float m_proportionFilled{ 0.0f }; 
 };
 
-class Grid : public IDrawable
+class Grid
 {
 public:
-    Grid(uint8_t width, uint8_t height, Drainer& drainer);
+    Grid(uint8_t width, uint8_t height, std::vector<Drainer>& drainers, uint32_t seed);
 
     bool drainCell(uint8_t row, uint8_t col, float& ret);
     void fillCell(float shrinkRate); // Grid's responsibility to choose a cell that has not been filled yet
     uint8_t update(float dt);
-    
-    virtual void draw(SDL_Renderer* renderer) override; // Grid's responsibility to draw everything
+
+    void snapshot(GameSnapshot& out); // Fills in cell and drainer state, drawing is done by GridView
+    bool isCellEmpty(uint8_t row, uint8_t col);
+    void save(GameState& out);
+    bool load(const GameState& in); // Returns false if the state is for a differently sized grid
 
 private:
+    uint32_t nextRandom();
+
+    uint32_t m_rngState; // xorshift32, kept here rather than rand() so that saved games replay identically
     std::vector<GridPosition> m_availableCells;
     std::vector<std::vector<Cell>> m_grid;
-    std::vector<std::vector<SDL_Rect>> m_drawGrid;
-    Drainer& m_drainer;
+    std::vector<Drainer>& m_drainers;
 
     /* TODO: I will add this feature once the game logic is done. Strikes will still appear in a bar at the top, just not directly on the cells for right now
      * Cells are added to the strikeCells when:
@@ -139,3 +233,67 @@ private:
 
 };
 
+
+/*
+ * All game state and rules, independent of input and rendering so that it can
+ * be stepped on its own thread at a fixed rate.
+ *
+ * Any number of agents (players or bots) each drive their own drainer. Moves
+ * take effect immediately in the order apply() is called, which the caller
+ * keeps deterministic by draining agent queues in index order. Drains are
+ * collected and resolved together at the start of the next update(): when
+ * several agents drain the same cell in one tick, priority rotates with the
+ * tick number so no agent always wins, and the losers are neither scored nor
+ * given a strike. Agents act on snapshots that are a little old and their
+ * commands arrive whenever their thread gets to push them, so a drain of a
+ * cell another agent emptied within the last CONTEST_WINDOW_MS is treated the
+ * same way rather than as a miss.
+ */
+class Game
+{
+public:
+    static constexpr const float CONTEST_WINDOW_MS = 250.0f;
+
+    Game(uint32_t seed, size_t numAgents = 1);
+
+    void apply(size_t agent, PlayerAction action);
+    void update(float dt); // Resolve drains, difficulty ramp, cell fills and draining
+    void snapshot(GameSnapshot& out);
+    bool isOver();
+    uint64_t tick();
+    size_t numAgents();
+    uint32_t seed();
+    bool isPractice();
+    void markPractice(); // Practice cannot be unmarked, a game that used it is never ranked
+
+    void save(GameState& out);
+    bool load(const GameState& in); // Returns false and leaves the game untouched if the state does not fit
+
+private:
+    struct PendingDrain
+    {
+        size_t agent;
+        GridPosition position; // Where the drainer was when it asked, not where it ended the tick
+    };
+
+    void resolveDrains();
+
+    std::vector<Drainer> m_drainers; // Declared before m_grid, which holds a reference to it
+    Grid m_grid;
+    std::vector<PendingDrain> m_pendingDrains;
+    std::vector<RecentDrain> m_recentDrains; // Oldest first, none older than CONTEST_WINDOW_MS
+    std::vector<int64_t> m_agentScores;
+    int64_t m_score{ 0 };
+    uint8_t m_strikes{ 0 };
+    uint64_t m_tick{ 0 };
+    uint32_t m_seed;
+    bool m_practice{ false };
+
+    float m_fillInterval_ms;
+    float m_drainRate;
+
+    float m_totalTimeElapsed_ms{ 0.0f };
+    float m_lastFillTime_ms{ 0.0f };
+    float m_lastFillPeriodUpdate_ms{ 0.0f };
+    float m_lastDrainRatePeriodUpdate_ms{ 0.0f };
+};
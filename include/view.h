@@ -0,0 +1,33 @@
+#pragma once
+
+#include "utils.h"
+#include "shrinky.h"
+
+/*
+ * Draws the grid from a GameSnapshot. Lives on the render thread and never
+ * touches the live Grid, which belongs to the simulation thread.
+ *
+ * Cells, fills and drainer highlights are each gathered into one list and
+ * drawn with a single batched SDL call, so large grids with many drainers
+ * cost a handful of draw calls rather than several per cell.
+ */
+class GridView : public IDrawable
+{
+public:
+    GridView(uint8_t width, uint8_t height);
+
+    void setSnapshot(const GameSnapshot* snapshot);
+
+    virtual void draw(SDL_Renderer* renderer) override;
+
+private:
+    void addHighlight(std::vector<SDL_Rect>& out, GridPosition position, int lineThickness);
+
+    std::vector<SDL_Rect> m_cellRects; // Row major
+    const GameSnapshot* m_snapshot{ nullptr };
+
+    // Reused every frame to avoid reallocating
+    std::vector<SDL_Rect> m_fillRects;
+    std::vector<SDL_Rect> m_playerHighlightRects;
+    std::vector<SDL_Rect> m_botHighlightRects;
+};
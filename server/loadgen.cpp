@@ -0,0 +1,375 @@
+/*
+ * shrinky-loadgen: opens many bot connections to shrinky-server, plays with a
+ * simple bot on each and reports command-to-ack latency percentiles.
+ *
+ * Each client drains its cell when the server says it is full and otherwise
+ * moves at random, at a fixed command rate. Finished games are replaced by
+ * reconnecting, so the number of live sessions stays constant.
+ */
+#include "protocol.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+struct LoadOptions
+{
+    uint16_t tcpPort{ 0 };
+    std::string unixPath;
+    uint32_t clients{ 100 };
+    double commandRate_hz{ 20.0 }; // Per client
+    double duration_s{ 10.0 };
+};
+
+struct Client
+{
+    int fd{ -1 };
+    bool welcomed{ false };
+    uint16_t agent{ 0 };
+    uint8_t gridWidth{ 0 };
+    int8_t row{ 0 };
+    int8_t col{ 0 };
+    std::vector<CellFrame> cells;                // Latest event per cell
+    std::vector<Clock::time_point> cellUpdated;  // When it arrived, cells are extrapolated from there
+    std::vector<uint8_t> input;
+    uint32_t nextSequence{ 0 };
+    Clock::time_point nextSend;
+};
+
+static uint64_t nowNanoseconds()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+static int connectTo(const LoadOptions& options)
+{
+    int fd;
+    if (!options.unixPath.empty())
+    {
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, options.unixPath.c_str(), sizeof(address.sun_path) - 1);
+        if (connect(fd, (sockaddr*)&address, sizeof(address)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    else
+    {
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(options.tcpPort);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(fd, (sockaddr*)&address, sizeof(address)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    return fd;
+}
+
+class LoadGenerator
+{
+public:
+    LoadGenerator(const LoadOptions& options);
+    bool run();
+
+private:
+    bool open(size_t index);
+    void readFrom(size_t index);
+    void handleInput(Client& client);
+    void handleFrame(Client& client, const uint8_t* frame);
+    void sendCommand(Client& client);
+    void report(double elapsed_s);
+
+    LoadOptions m_options;
+    int m_epollFd;
+    std::vector<Client> m_clients;
+    std::mt19937 m_rng{ 1234 };
+
+    std::vector<uint32_t> m_latencies_us;
+    uint64_t m_sent{ 0 };
+    uint64_t m_gamesFinished{ 0 };
+    uint64_t m_bytesReceived{ 0 };
+};
+
+LoadGenerator::LoadGenerator(const LoadOptions& options)
+    : m_options(options), m_clients(options.clients)
+{
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+}
+
+bool LoadGenerator::open(size_t index)
+{
+    Client& client = m_clients[index];
+    client = Client();
+    client.fd = connectTo(m_options);
+    if (client.fd < 0)
+    {
+        std::cerr << "Cannot connect: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Spread the first commands over one interval so clients do not send in lockstep
+    std::uniform_real_distribution<double> offset(0.0, 1.0 / m_options.commandRate_hz);
+    client.nextSend = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(offset(m_rng)));
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = index;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, client.fd, &event);
+    return true;
+}
+
+bool LoadGenerator::run()
+{
+    for (size_t i = 0; i < m_clients.size(); i++)
+    {
+        if (!open(i))
+            return false;
+    }
+
+    auto interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / m_options.commandRate_hz));
+    auto start = Clock::now();
+    auto end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(m_options.duration_s));
+    epoll_event events[256];
+
+    while (Clock::now() < end)
+    {
+        int numEvents = epoll_wait(m_epollFd, events, 256, 1);
+        for (int i = 0; i < numEvents; i++)
+        {
+            readFrom(events[i].data.u64);
+        }
+
+        auto now = Clock::now();
+        for (Client& client : m_clients)
+        {
+            if (client.welcomed && now >= client.nextSend)
+            {
+                sendCommand(client);
+                client.nextSend += interval;
+                if (client.nextSend < now)
+                    client.nextSend = now + interval; // Fell behind, do not burst
+            }
+        }
+    }
+
+    report(std::chrono::duration<double>(Clock::now() - start).count());
+
+    for (Client& client : m_clients)
+    {
+        if (client.fd >= 0)
+            close(client.fd);
+    }
+    close(m_epollFd);
+    return true;
+}
+
+void LoadGenerator::readFrom(size_t index)
+{
+    Client& client = m_clients[index];
+    uint8_t buffer[16 * 1024];
+
+    while (true)
+    {
+        ssize_t numRead = recv(client.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (numRead == 0 || (numRead < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        {
+            // Game over, or the server went away. The final batch arrives just before the close, count its acks
+            // before the client is reset, then start a fresh session in its place.
+            handleInput(client);
+            close(client.fd);
+            m_gamesFinished++;
+            open(index);
+            return;
+        }
+
+        if (numRead < 0)
+            break;
+
+        m_bytesReceived += numRead;
+        client.input.insert(client.input.end(), buffer, buffer + numRead);
+    }
+
+    handleInput(client);
+}
+
+void LoadGenerator::handleInput(Client& client)
+{
+    size_t offset = 0;
+    for (; client.input.size() - offset >= FRAME_SIZE; offset += FRAME_SIZE)
+    {
+        handleFrame(client, client.input.data() + offset);
+    }
+    client.input.erase(client.input.begin(), client.input.begin() + offset);
+}
+
+void LoadGenerator::handleFrame(Client& client, const uint8_t* frame)
+{
+    switch (static_cast<FrameType>(frame[0]))
+    {
+        case FrameType::WELCOME:
+        {
+            WelcomeFrame welcome;
+            std::memcpy(&welcome, frame, sizeof(welcome));
+            client.welcomed = true;
+            client.agent = welcome.agent;
+            client.gridWidth = welcome.gridWidth;
+            client.cells.assign(welcome.gridWidth * welcome.gridHeight, CellFrame{});
+            client.cellUpdated.assign(client.cells.size(), Clock::now());
+            break;
+        }
+        case FrameType::ACK:
+        {
+            AckFrame ack;
+            std::memcpy(&ack, frame, sizeof(ack));
+            m_latencies_us.push_back((nowNanoseconds() - ack.clientTime) / 1000);
+            break;
+        }
+        case FrameType::DRAINER:
+        {
+            DrainerFrame drainer;
+            std::memcpy(&drainer, frame, sizeof(drainer));
+            if (drainer.agent == client.agent)
+            {
+                client.row = drainer.row;
+                client.col = drainer.col;
+            }
+            break;
+        }
+        case FrameType::CELL:
+        {
+            CellFrame cell;
+            std::memcpy(&cell, frame, sizeof(cell));
+            if (cell.cellIndex < client.cells.size())
+            {
+                client.cells[cell.cellIndex] = cell;
+                client.cellUpdated[cell.cellIndex] = Clock::now();
+            }
+            break;
+        }
+        default:
+            break; // TICK carries nothing the bot needs
+    }
+}
+
+void LoadGenerator::sendCommand(Client& client)
+{
+    CommandFrame command{};
+    command.type = FrameType::COMMAND;
+    command.sequence = client.nextSequence++;
+
+    // Extrapolate the cell under us from its last event
+    size_t index = client.row * client.gridWidth + client.col;
+    bool full = false;
+    if (index < client.cells.size())
+    {
+        const CellFrame& cell = client.cells[index];
+        float elapsed_s = std::chrono::duration<float>(Clock::now() - client.cellUpdated[index]).count();
+        full = cell.fullness - cell.shrinkRate * elapsed_s > 0.0f;
+    }
+
+    if (full)
+    {
+        command.action = WireAction::DRAIN;
+        client.cells[index].fullness = 0.0f; // Do not drain it twice before the server catches up
+    }
+    else
+    {
+        command.action = static_cast<WireAction>(m_rng() % 4);
+    }
+
+    command.clientTime = nowNanoseconds();
+    if (::send(client.fd, &command, sizeof(command), MSG_NOSIGNAL | MSG_DONTWAIT) == sizeof(command))
+        m_sent++;
+}
+
+void LoadGenerator::report(double elapsed_s)
+{
+    std::sort(m_latencies_us.begin(), m_latencies_us.end());
+    auto percentile = [&](double p) -> uint32_t
+    {
+        if (m_latencies_us.empty())
+            return 0;
+        return m_latencies_us[std::min(m_latencies_us.size() - 1, (size_t)(p * m_latencies_us.size()))];
+    };
+
+    std::cout << "clients " << m_clients.size() << ", " << elapsed_s << " s" << std::endl
+        << "commands sent " << m_sent << " (" << m_sent / elapsed_s << "/s), acked " << m_latencies_us.size() << std::endl
+        << "games finished " << m_gamesFinished << ", received " << m_bytesReceived / elapsed_s / 1e6 << " MB/s" << std::endl
+        << "command-to-ack latency us: p50 " << percentile(0.50) << " p90 " << percentile(0.90)
+        << " p99 " << percentile(0.99) << " p99.9 " << percentile(0.999)
+        << " max " << (m_latencies_us.empty() ? 0 : m_latencies_us.back()) << std::endl;
+}
+
+static void printUsage()
+{
+    std::cout << "Usage: shrinky-loadgen [--tcp PORT] [--unix PATH] [--clients N] [--rate HZ] [--duration S]" << std::endl
+        << "  --tcp PORT    connect to 127.0.0.1:PORT (default " << SHRINKY_DEFAULT_PORT << " if no --unix)" << std::endl
+        << "  --unix PATH   connect to a unix socket" << std::endl
+        << "  --clients N   concurrent bot connections (default 100)" << std::endl
+        << "  --rate HZ     commands per second per client (default 20)" << std::endl
+        << "  --duration S  seconds to run (default 10)" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    LoadOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--tcp" && hasValue)
+            options.tcpPort = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--unix" && hasValue)
+            options.unixPath = argv[++i];
+        else if (arg == "--clients" && hasValue)
+            options.clients = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--rate" && hasValue)
+            options.commandRate_hz = std::strtod(argv[++i], nullptr);
+        else if (arg == "--duration" && hasValue)
+            options.duration_s = std::strtod(argv[++i], nullptr);
+        else
+        {
+            printUsage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    if (options.tcpPort == 0 && options.unixPath.empty())
+        options.tcpPort = SHRINKY_DEFAULT_PORT;
+
+    if (options.clients < 1 || options.commandRate_hz <= 0.0 || options.duration_s <= 0.0)
+    {
+        printUsage();
+        return 1;
+    }
+
+    LoadGenerator generator(options);
+    return generator.run() ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Wire protocol between shrinky-server and bots.
+ *
+ * Every message in either direction is one fixed 16 byte frame in host byte
+ * order (both ends are on the same machine), so a reader only ever has to
+ * check for 16 buffered bytes. The first byte is always the FrameType.
+ *
+ * After connecting, a client receives one WelcomeFrame once its session has
+ * all its agents. It then sends CommandFrames whenever it likes; commands
+ * sent before the WelcomeFrame, or past 8 from one client in a tick, are
+ * dropped without an ack. Once per
+ * tick where something changed, the server sends one batch for the tick: a
+ * TickFrame, then AckFrames for this client's commands applied in that tick,
+ * then DrainerFrames and CellFrames for whatever changed since the last batch.
+ *
+ * Cells are sent as events rather than every tick: a CellFrame gives the
+ * fullness at that tick and how fast it is draining, and clients extrapolate
+ * until the next CellFrame for that cell. A session only costs a write on
+ * ticks where a cell was filled or drained, a drainer moved or a command was
+ * acked.
+ * When the game ends the batch has gameOver set and the server closes the
+ * connection after sending it.
+ */
+
+static constexpr const uint16_t SHRINKY_DEFAULT_PORT = 7878;
+static constexpr const char* SHRINKY_DEFAULT_SOCKET = "/tmp/shrinky.sock";
+
+enum class FrameType : uint8_t
+{
+    COMMAND = 1, // Client -> server
+    WELCOME,     // Server -> client
+    TICK,
+    ACK,
+    DRAINER,
+    CELL
+};
+
+// Values of CommandFrame::action, same order as PlayerAction
+enum class WireAction : uint8_t
+{
+    MOVE_UP,
+    MOVE_DOWN,
+    MOVE_LEFT,
+    MOVE_RIGHT,
+    DRAIN
+};
+
+struct CommandFrame
+{
+    FrameType type;
+    WireAction action;
+    uint8_t reserved[2];
+    uint32_t sequence;    // Echoed in the AckFrame
+    uint64_t clientTime;  // Opaque to the server, echoed in the AckFrame for latency measurement
+};
+
+struct WelcomeFrame
+{
+    FrameType type;
+    uint8_t gridWidth;
+    uint8_t gridHeight;
+    uint8_t reserved;
+    uint16_t agent;     // This client's agent index within the session
+    uint16_t numAgents;
+    uint32_t session;
+    uint32_t tickRate_hz;
+};
+
+struct TickFrame
+{
+    FrameType type;
+    uint8_t strikes;
+    uint8_t gameOver;
+    uint8_t reserved;
+    uint32_t tick;
+    int64_t score; // Session total
+};
+
+struct AckFrame
+{
+    FrameType type;
+    uint8_t reserved[3];
+    uint32_t sequence;
+    uint64_t clientTime;
+};
+
+struct DrainerFrame
+{
+    FrameType type;
+    int8_t row;
+    int8_t col;
+    uint8_t reserved;
+    uint16_t agent;
+    uint8_t reserved2[2];
+    int64_t score;
+};
+
+// Fullness falls by shrinkRate per second until it reaches 0, see Cell::fill()
+struct CellFrame
+{
+    FrameType type;
+    uint8_t reserved;
+    uint16_t cellIndex; // Row major
+    float fullness;     // 0 is empty
+    float shrinkRate;
+    uint32_t reserved2;
+};
+
+static constexpr const size_t FRAME_SIZE = 16;
+static_assert(sizeof(CommandFrame) == FRAME_SIZE, "Frames must be FRAME_SIZE bytes");
+static_assert(sizeof(WelcomeFrame) == FRAME_SIZE, "Frames must be FRAME_SIZE bytes");
+static_assert(sizeof(TickFrame) == FRAME_SIZE, "Frames must be FRAME_SIZE bytes");
+static_assert(sizeof(AckFrame) == FRAME_SIZE, "Frames must be FRAME_SIZE bytes");
+static_assert(sizeof(DrainerFrame) == FRAME_SIZE, "Frames must be FRAME_SIZE bytes");
+static_assert(sizeof(CellFrame) == FRAME_SIZE, "Frames must be FRAME_SIZE bytes");
@@ -0,0 +1,734 @@
+/*
+ * shrinky-server: hosts many independent headless shrinky sessions in one
+ * process for bot tournaments. Runs the same Game logic as the SDL client on a
+ * single epoll thread, see protocol.h for the wire format.
+ *
+ * Each connection is one agent. Connections are grouped into sessions of
+ * --agents clients in the order they arrive, and a session starts once it is
+ * full. Commands are applied at the next tick in agent order, exactly like the
+ * client's simulation thread, and every client gets at most one batched write
+ * per tick.
+ */
+#include "shrinky.h"
+#include "protocol.h"
+
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// A client this far behind on reading is dropped rather than buffered forever
+static constexpr const size_t MAX_OUTPUT_BUFFER = 1 << 20;
+static constexpr const int MAX_EPOLL_EVENTS = 256;
+
+// Commands past this many from one agent within a tick are dropped unacked
+static constexpr const size_t MAX_COMMANDS_PER_TICK = 8;
+
+static volatile std::sig_atomic_t g_stop = 0;
+
+static void onSignal(int)
+{
+    g_stop = 1;
+}
+
+struct ServerOptions
+{
+    uint16_t tcpPort{ 0 };
+    std::string unixPath;
+    uint32_t agentsPerSession{ 1 };
+    uint32_t tickRate_hz{ 60 };
+    uint32_t gridSize{ 4 };
+};
+
+/*
+ * One connected bot
+ */
+struct Connection
+{
+    int fd{ -1 };
+    uint32_t session{ 0 };
+    uint16_t agent{ 0 };
+    bool closing{ false };     // Close once the output buffer has been written
+    bool wantsWrite{ false };  // Registered for EPOLLOUT
+
+    std::vector<uint8_t> input;
+    std::vector<uint8_t> output;
+    size_t outputOffset{ 0 };
+    std::vector<AckFrame> acks; // Commands applied this tick, sent with the next batch
+};
+
+/*
+ * One game and the agents playing it
+ */
+struct Session
+{
+    struct PendingCommand
+    {
+        int fd;
+        CommandFrame frame;
+    };
+
+    uint32_t id{ 0 };
+    std::unique_ptr<Game> game;
+    std::vector<int> agentFds; // -1 once that agent has disconnected
+    std::vector<std::vector<PendingCommand>> pending; // Per agent, in arrival order
+    bool started{ false };
+    bool over{ false };
+
+    // What clients were last told, to send only what changed
+    GameState state;
+    std::vector<CellState> sentCells;
+    std::vector<float> previousFullness; // Last tick's, to spot a cell drained and refilled within one tick
+    std::vector<GridPosition> sentPositions;
+    std::vector<int64_t> sentAgentScores;
+    int64_t sentScore{ -1 };
+    uint8_t sentStrikes{ 0 };
+
+    std::vector<uint8_t> batch; // Frames shared by every client in the session this tick
+};
+
+class Server
+{
+public:
+    Server(const ServerOptions& options);
+    ~Server();
+
+    bool listen();
+    void run();
+
+private:
+    void addListener(int fd);
+    void acceptAll(int listenFd);
+    void joinSession(Connection& connection);
+    void startSession(Session& session);
+
+    void readFrom(Connection& connection);
+    void handleFrame(Connection& connection, const uint8_t* frame);
+
+    void tick();
+    void tickSession(Session& session);
+    bool buildBatch(Session& session); // Returns false if clients have not missed anything
+
+    void send(Connection& connection, const void* data, size_t size);
+    void flush(Connection& connection);
+    void setWantsWrite(Connection& connection, bool wantsWrite);
+    void disconnect(int fd);
+
+    ServerOptions m_options;
+    int m_epollFd{ -1 };
+    std::vector<int> m_listenFds;
+
+    std::vector<std::unique_ptr<Connection>> m_connections; // Indexed by fd
+    std::unordered_map<uint32_t, std::unique_ptr<Session>> m_sessions;
+    uint32_t m_nextSessionId{ 1 };
+    uint32_t m_fillingSession{ 0 }; // Session waiting for more agents, 0 if none
+
+    // Stats, reported every few seconds
+    uint64_t m_ticks{ 0 };
+    uint64_t m_commands{ 0 };
+    uint64_t m_bytesSent{ 0 };
+    double m_tickTime_ms{ 0.0 };
+    double m_maxTickTime_ms{ 0.0 };
+};
+
+Server::Server(const ServerOptions& options)
+    : m_options(options)
+{
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+}
+
+Server::~Server()
+{
+    for (auto& connection : m_connections)
+    {
+        if (connection)
+            close(connection->fd);
+    }
+
+    for (int fd : m_listenFds)
+    {
+        close(fd);
+    }
+
+    if (!m_options.unixPath.empty())
+        unlink(m_options.unixPath.c_str());
+
+    close(m_epollFd);
+}
+
+bool Server::listen()
+{
+    if (m_options.tcpPort != 0)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        // Loopback only, this is for local bot tournaments
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(m_options.tcpPort);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        if (bind(fd, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(fd, SOMAXCONN) != 0)
+        {
+            std::cerr << "Cannot listen on 127.0.0.1:" << m_options.tcpPort << ": " << std::strerror(errno) << std::endl;
+            close(fd);
+            return false;
+        }
+
+        addListener(fd);
+        std::cout << "Listening on 127.0.0.1:" << m_options.tcpPort << std::endl;
+    }
+
+    if (!m_options.unixPath.empty())
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, m_options.unixPath.c_str(), sizeof(address.sun_path) - 1);
+        unlink(m_options.unixPath.c_str());
+
+        if (bind(fd, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(fd, SOMAXCONN) != 0)
+        {
+            std::cerr << "Cannot listen on " << m_options.unixPath << ": " << std::strerror(errno) << std::endl;
+            close(fd);
+            return false;
+        }
+
+        addListener(fd);
+        std::cout << "Listening on " << m_options.unixPath << std::endl;
+    }
+
+    return !m_listenFds.empty();
+}
+
+void Server::addListener(int fd)
+{
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event);
+    m_listenFds.push_back(fd);
+}
+
+void Server::run()
+{
+    using Clock = std::chrono::steady_clock;
+    auto tickDuration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / m_options.tickRate_hz));
+    auto nextTick = Clock::now() + tickDuration;
+    auto nextReport = Clock::now() + std::chrono::seconds(5);
+    epoll_event events[MAX_EPOLL_EVENTS];
+
+    while (!g_stop)
+    {
+        auto now = Clock::now();
+        // Rounded up, truncating would busy-poll through the last partial millisecond before every tick
+        int timeout_ms = 0;
+        if (nextTick > now)
+            timeout_ms = std::chrono::ceil<std::chrono::milliseconds>(nextTick - now).count();
+
+        int numEvents = epoll_wait(m_epollFd, events, MAX_EPOLL_EVENTS, timeout_ms);
+        for (int i = 0; i < numEvents; i++)
+        {
+            int fd = events[i].data.fd;
+            if (std::find(m_listenFds.begin(), m_listenFds.end(), fd) != m_listenFds.end())
+            {
+                acceptAll(fd);
+                continue;
+            }
+
+            if (fd >= (int)m_connections.size() || !m_connections[fd])
+                continue;
+
+            Connection& connection = *m_connections[fd];
+            if (events[i].events & (EPOLLERR | EPOLLHUP))
+            {
+                disconnect(fd);
+                continue;
+            }
+
+            if (events[i].events & EPOLLOUT)
+                flush(connection);
+
+            // flush() may have closed it
+            if ((events[i].events & EPOLLIN) && m_connections[fd])
+                readFrom(connection);
+        }
+
+        now = Clock::now();
+        if (now >= nextTick)
+        {
+            auto start = Clock::now();
+            tick();
+            double tickTime_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            m_tickTime_ms += tickTime_ms;
+            m_maxTickTime_ms = std::max(m_maxTickTime_ms, tickTime_ms);
+
+            // Fixed rate, but do not try to catch up on ticks lost to a long stall
+            nextTick += tickDuration;
+            if (nextTick < now)
+                nextTick = now + tickDuration;
+        }
+
+        if (now >= nextReport)
+        {
+            size_t numConnections = 0;
+            for (auto& connection : m_connections)
+            {
+                numConnections += connection ? 1 : 0;
+            }
+
+            std::cout << "sessions " << m_sessions.size()
+                << " connections " << numConnections
+                << " ticks/s " << m_ticks / 5.0
+                << " commands/s " << m_commands / 5.0
+                << " MB/s out " << m_bytesSent / 5.0 / 1e6
+                << " tick avg " << (m_ticks ? m_tickTime_ms / m_ticks : 0.0) << " ms"
+                << " max " << m_maxTickTime_ms << " ms" << std::endl;
+
+            m_ticks = m_commands = m_bytesSent = 0;
+            m_tickTime_ms = m_maxTickTime_ms = 0.0;
+            nextReport = now + std::chrono::seconds(5);
+        }
+    }
+}
+
+void Server::acceptAll(int listenFd)
+{
+    while (true)
+    {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return; // EAGAIN, or out of fds and the client will retry
+
+        // Batches are already one write per tick, do not let Nagle hold them back
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event);
+
+        if (fd >= (int)m_connections.size())
+            m_connections.resize(fd + 1);
+
+        m_connections[fd] = std::make_unique<Connection>();
+        m_connections[fd]->fd = fd;
+        joinSession(*m_connections[fd]);
+    }
+}
+
+void Server::joinSession(Connection& connection)
+{
+    if (m_fillingSession == 0)
+    {
+        auto session = std::make_unique<Session>();
+        session->id = m_nextSessionId++;
+
+        // Sessions get different seeds but the server's games are reproducible run to run
+        session->game = std::make_unique<Game>(session->id * 2654435761u, m_options.agentsPerSession);
+        session->pending.resize(m_options.agentsPerSession);
+
+        m_fillingSession = session->id;
+        m_sessions[session->id] = std::move(session);
+    }
+
+    Session& session = *m_sessions[m_fillingSession];
+    connection.session = session.id;
+    connection.agent = session.agentFds.size();
+    session.agentFds.push_back(connection.fd);
+
+    if (session.agentFds.size() == m_options.agentsPerSession)
+    {
+        m_fillingSession = 0;
+        startSession(session);
+    }
+}
+
+void Server::startSession(Session& session)
+{
+    session.started = true;
+
+    WelcomeFrame welcome{};
+    welcome.type = FrameType::WELCOME;
+    welcome.gridWidth = config.gridWidth_cells;
+    welcome.gridHeight = config.gridHeight_cells;
+    welcome.numAgents = session.agentFds.size();
+    welcome.session = session.id;
+    welcome.tickRate_hz = m_options.tickRate_hz;
+
+    for (int fd : session.agentFds)
+    {
+        if (fd < 0)
+            continue;
+
+        Connection& connection = *m_connections[fd];
+        welcome.agent = connection.agent;
+        send(connection, &welcome, sizeof(welcome));
+        flush(connection);
+    }
+}
+
+void Server::readFrom(Connection& connection)
+{
+    int fd = connection.fd;
+    uint8_t buffer[16 * 1024];
+
+    while (true)
+    {
+        ssize_t numRead = recv(fd, buffer, sizeof(buffer), 0);
+        if (numRead == 0 || (numRead < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        {
+            disconnect(fd);
+            return;
+        }
+
+        if (numRead < 0)
+            break;
+
+        connection.input.insert(connection.input.end(), buffer, buffer + numRead);
+    }
+
+    size_t offset = 0;
+    while (connection.input.size() - offset >= FRAME_SIZE)
+    {
+        handleFrame(connection, connection.input.data() + offset);
+        if (!m_connections[fd])
+            return; // Dropped for sending garbage
+
+        offset += FRAME_SIZE;
+    }
+
+    connection.input.erase(connection.input.begin(), connection.input.begin() + offset);
+}
+
+void Server::handleFrame(Connection& connection, const uint8_t* frame)
+{
+    CommandFrame command;
+    std::memcpy(&command, frame, sizeof(command));
+
+    if (command.type != FrameType::COMMAND || command.action > WireAction::DRAIN)
+    {
+        disconnect(connection.fd);
+        return;
+    }
+
+    // Commands sent before the WelcomeFrame are dropped so no agent can queue up moves before the game starts
+    auto it = m_sessions.find(connection.session);
+    if (it == m_sessions.end() || !it->second->started || it->second->over)
+        return;
+
+    std::vector<Session::PendingCommand>& pending = it->second->pending[connection.agent];
+    if (pending.size() >= MAX_COMMANDS_PER_TICK)
+        return;
+
+    pending.push_back({ connection.fd, command });
+}
+
+void Server::tick()
+{
+    m_ticks++;
+
+    for (auto it = m_sessions.begin(); it != m_sessions.end();)
+    {
+        Session& session = *it->second;
+        if (session.started && !session.over)
+            tickSession(session);
+
+        // Done once every agent is gone
+        bool anyConnected = false;
+        for (int fd : session.agentFds)
+        {
+            anyConnected = anyConnected || fd >= 0;
+        }
+
+        if (!anyConnected)
+        {
+            if (m_fillingSession == session.id)
+                m_fillingSession = 0;
+            it = m_sessions.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void Server::tickSession(Session& session)
+{
+    Game& game = *session.game;
+
+    // Agent order, so a session plays out the same however commands interleaved on the wire
+    for (size_t agent = 0; agent < session.pending.size(); agent++)
+    {
+        for (const Session::PendingCommand& pending : session.pending[agent])
+        {
+            game.apply(agent, static_cast<PlayerAction>(pending.frame.action));
+            m_commands++;
+
+            if (pending.fd >= 0 && m_connections[pending.fd])
+            {
+                AckFrame ack{};
+                ack.type = FrameType::ACK;
+                ack.sequence = pending.frame.sequence;
+                ack.clientTime = pending.frame.clientTime;
+                m_connections[pending.fd]->acks.push_back(ack);
+            }
+        }
+        session.pending[agent].clear();
+    }
+
+    game.update(1000.0f / m_options.tickRate_hz);
+    game.save(session.state);
+    session.over = game.isOver();
+
+    bool changed = buildBatch(session);
+
+    TickFrame tickFrame{};
+    tickFrame.type = FrameType::TICK;
+    tickFrame.strikes = session.state.strikes;
+    tickFrame.gameOver = session.over;
+    tickFrame.tick = game.tick();
+    tickFrame.score = session.state.score;
+
+    for (int fd : session.agentFds)
+    {
+        if (fd < 0)
+            continue;
+
+        Connection& connection = *m_connections[fd];
+        if (!changed && connection.acks.empty())
+            continue; // Nothing new, skip the write entirely
+
+        send(connection, &tickFrame, sizeof(tickFrame));
+        send(connection, connection.acks.data(), connection.acks.size() * sizeof(AckFrame));
+        send(connection, session.batch.data(), session.batch.size());
+        connection.acks.clear();
+
+        connection.closing = session.over;
+        flush(connection);
+    }
+}
+
+bool Server::buildBatch(Session& session)
+{
+    const GameState& state = session.state;
+    session.batch.clear();
+
+    if (session.sentCells.empty())
+    {
+        // First tick, everything counts as changed
+        session.sentCells.assign(state.cells.size(), { -1.0f, -1.0f });
+        session.previousFullness.assign(state.cells.size(), 0.0f);
+        session.sentPositions.assign(state.drainerPositions.size(), GridPosition(INT8_MAX, INT8_MAX));
+        session.sentAgentScores.assign(state.agentScores.size(), -1);
+    }
+
+    bool changed = state.score != session.sentScore || state.strikes != session.sentStrikes || session.over;
+    session.sentScore = state.score;
+    session.sentStrikes = state.strikes;
+
+    for (size_t agent = 0; agent < state.drainerPositions.size(); agent++)
+    {
+        GridPosition position = state.drainerPositions[agent];
+        int64_t score = state.agentScores[agent];
+        if (position.row == session.sentPositions[agent].row && position.col == session.sentPositions[agent].col
+            && score == session.sentAgentScores[agent])
+            continue;
+
+        DrainerFrame frame{};
+        frame.type = FrameType::DRAINER;
+        frame.row = position.row;
+        frame.col = position.col;
+        frame.agent = agent;
+        frame.score = score;
+
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&frame);
+        session.batch.insert(session.batch.end(), bytes, bytes + sizeof(frame));
+        session.sentPositions[agent] = position;
+        session.sentAgentScores[agent] = score;
+    }
+
+    for (size_t i = 0; i < state.cells.size(); i++)
+    {
+        // Clients extrapolate draining cells themselves, only fills and drains are news
+        const CellState& cell = state.cells[i];
+        const CellState& sent = session.sentCells[i];
+        bool isFull = cell.proportionFilled > 0.0f;
+        bool wasFull = sent.proportionFilled > 0.0f;
+        bool refilled = cell.proportionFilled > session.previousFullness[i];
+        session.previousFullness[i] = cell.proportionFilled;
+
+        if (isFull == wasFull && (!isFull || (cell.shrinkRate == sent.shrinkRate && !refilled)))
+            continue;
+
+        CellFrame frame{};
+        frame.type = FrameType::CELL;
+        frame.cellIndex = i;
+        frame.fullness = cell.proportionFilled;
+        frame.shrinkRate = isFull ? cell.shrinkRate : 0.0f;
+
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&frame);
+        session.batch.insert(session.batch.end(), bytes, bytes + sizeof(frame));
+        session.sentCells[i] = { frame.fullness, frame.shrinkRate };
+    }
+
+    return changed || !session.batch.empty();
+}
+
+void Server::send(Connection& connection, const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    connection.output.insert(connection.output.end(), bytes, bytes + size);
+}
+
+void Server::flush(Connection& connection)
+{
+    int fd = connection.fd;
+
+    while (connection.outputOffset < connection.output.size())
+    {
+        ssize_t numSent = ::send(fd, connection.output.data() + connection.outputOffset,
+            connection.output.size() - connection.outputOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+        if (numSent < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                disconnect(fd);
+                return;
+            }
+
+            if (connection.output.size() - connection.outputOffset > MAX_OUTPUT_BUFFER)
+            {
+                disconnect(fd);
+                return;
+            }
+
+            // Socket full, finish when epoll says it is writable
+            setWantsWrite(connection, true);
+            return;
+        }
+
+        connection.outputOffset += numSent;
+        m_bytesSent += numSent;
+    }
+
+    connection.output.clear();
+    connection.outputOffset = 0;
+    setWantsWrite(connection, false);
+
+    if (connection.closing)
+        disconnect(fd);
+}
+
+void Server::setWantsWrite(Connection& connection, bool wantsWrite)
+{
+    if (connection.wantsWrite == wantsWrite)
+        return;
+
+    epoll_event event{};
+    event.events = EPOLLIN | (wantsWrite ? EPOLLOUT : 0);
+    event.data.fd = connection.fd;
+    epoll_ctl(m_epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+    connection.wantsWrite = wantsWrite;
+}
+
+void Server::disconnect(int fd)
+{
+    Connection& connection = *m_connections[fd];
+
+    auto it = m_sessions.find(connection.session);
+    if (it != m_sessions.end())
+    {
+        Session& session = *it->second;
+        session.agentFds[connection.agent] = -1;
+        for (auto& agentPending : session.pending)
+        {
+            for (auto& pending : agentPending)
+            {
+                if (pending.fd == fd)
+                    pending.fd = -1; // Still applied, just not acked
+            }
+        }
+    }
+
+    close(fd);
+    m_connections[fd].reset();
+}
+
+static void printUsage()
+{
+    std::cout << "Usage: shrinky-server [--tcp PORT] [--unix PATH] [--agents N] [--tick-hz HZ] [--grid N]" << std::endl
+        << "  --tcp PORT    listen on 127.0.0.1:PORT (default " << SHRINKY_DEFAULT_PORT << " if no --unix)" << std::endl
+        << "  --unix PATH   listen on a unix socket" << std::endl
+        << "  --agents N    bots per session, sessions start once full (default 1)" << std::endl
+        << "  --tick-hz HZ  simulation rate (default 60)" << std::endl
+        << "  --grid N      N by N grid (default 4)" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    ServerOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--tcp" && hasValue)
+            options.tcpPort = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--unix" && hasValue)
+            options.unixPath = argv[++i];
+        else if (arg == "--agents" && hasValue)
+            options.agentsPerSession = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--tick-hz" && hasValue)
+            options.tickRate_hz = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--grid" && hasValue)
+            options.gridSize = std::strtoul(argv[++i], nullptr, 10);
+        else
+        {
+            printUsage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    if (options.tcpPort == 0 && options.unixPath.empty())
+        options.tcpPort = SHRINKY_DEFAULT_PORT;
+
+    if (options.agentsPerSession < 1 || options.agentsPerSession > UINT16_MAX || options.tickRate_hz < 1
+        || options.gridSize < 1 || options.gridSize > 100)
+    {
+        printUsage();
+        return 1;
+    }
+
+    config.setGridSize(options.gridSize, options.gridSize);
+
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    Server server(options);
+    if (!server.listen())
+        return 1;
+
+    server.run();
+    return 0;
+}
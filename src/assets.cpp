@@ -0,0 +1,29 @@
+#include "assets.h"
+
+#include <cstring>
+
+#include "SDL2/SDL.h"
+
+const Asset* findAsset(const std::string& path)
+{
+    // Only a handful of assets, linear search is plenty
+    for (size_t i = 0; i < g_numAssets; i++)
+    {
+        if (std::strcmp(g_assets[i].path, path.c_str()) == 0)
+            return &g_assets[i];
+    }
+
+    return nullptr;
+}
+
+SDL_RWops* openAsset(const std::string& path)
+{
+    const Asset* asset = findAsset(path);
+    if (asset == nullptr)
+    {
+        SDL_SetError("No packed asset named '%s'", path.c_str());
+        return nullptr;
+    }
+
+    return SDL_RWFromConstMem(asset->data, static_cast<int>(asset->size));
+}
@@ -0,0 +1,36 @@
+#include "bot.h"
+
+bool chooseBotAction(const GameSnapshot& snapshot, const std::vector<GridPosition>& fullCells, size_t agent, PlayerAction& out)
+{
+    if (agent >= snapshot.drainerPositions.size() || fullCells.empty())
+        return false;
+
+    GridPosition position = snapshot.drainerPositions[agent];
+
+    // Start the search at a different cell for each bot so ties do not send every bot to the same place
+    const GridPosition* target = nullptr;
+    int bestDistance = INT32_MAX;
+    for (size_t i = 0; i < fullCells.size(); i++)
+    {
+        const GridPosition& cell = fullCells[(i + agent) % fullCells.size()];
+        int distance = std::abs(cell.row - position.row) + std::abs(cell.col - position.col);
+        if (distance < bestDistance)
+        {
+            bestDistance = distance;
+            target = &cell;
+        }
+    }
+
+    if (bestDistance == 0)
+        out = PlayerAction::DRAIN;
+    else if (target->row < position.row)
+        out = PlayerAction::MOVE_UP;
+    else if (target->row > position.row)
+        out = PlayerAction::MOVE_DOWN;
+    else if (target->col < position.col)
+        out = PlayerAction::MOVE_LEFT;
+    else
+        out = PlayerAction::MOVE_RIGHT;
+
+    return true;
+}
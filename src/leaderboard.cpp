@@ -0,0 +1,484 @@
+#include "leaderboard.h"
+
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr const uint32_t LEADERBOARD_MAGIC = 0x444C4253; // "SBLD"
+static constexpr const uint16_t LEADERBOARD_VERSION = 1;
+
+// Two page aligned header slots, records start after them
+static constexpr const size_t HEADER_SLOT_SIZE = 8192;
+static constexpr const size_t RECORDS_OFFSET = 2 * HEADER_SLOT_SIZE;
+static constexpr const size_t MIN_CAPACITY = 1024;
+
+struct Leaderboard::Header
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint64_t sequence; // Of the two valid slots, the higher sequence is current
+    uint64_t committedRecords;
+    uint32_t topCount;
+    uint32_t configCount;
+    LeaderboardEntry top[TOP_K];
+    ConfigAggregate configs[MAX_CONFIGS];
+    uint64_t checksum; // Of everything above
+};
+
+static_assert(sizeof(Leaderboard::Header) <= HEADER_SLOT_SIZE, "Header must fit in its slot");
+static_assert(sizeof(SessionRecord) == 48, "SessionRecord is part of the file format");
+
+static uint64_t fnv1a(const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static uint64_t headerChecksum(const Leaderboard::Header& header)
+{
+    return fnv1a(&header, offsetof(Leaderboard::Header, checksum));
+}
+
+static uint32_t recordChecksum(const SessionRecord& record)
+{
+    return static_cast<uint32_t>(fnv1a(&record, offsetof(SessionRecord, checksum)));
+}
+
+static bool syncRange(void* start, size_t size)
+{
+    // msync wants a page aligned start
+    uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+    uintptr_t address = reinterpret_cast<uintptr_t>(start);
+    uintptr_t aligned = address & ~(pageSize - 1);
+    return msync(reinterpret_cast<void*>(aligned), size + (address - aligned), MS_SYNC) == 0;
+}
+
+////////////////////////////////
+// Leaderboard
+////////////////////////////////
+Leaderboard::Leaderboard() = default;
+
+Leaderboard::~Leaderboard()
+{
+    close();
+}
+
+bool Leaderboard::open(const std::string& path)
+{
+    close();
+
+    m_path = path;
+    m_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (m_fd < 0)
+        return false;
+
+    m_header = std::make_unique<Header>();
+
+    // Locked even just to read, a new file is initialized here and must only be initialized once
+    if (!lockFile())
+    {
+        close();
+        return false;
+    }
+
+    bool ok = loadHeader();
+    unlockFile();
+    if (!ok)
+        close();
+    return ok;
+}
+
+void Leaderboard::close()
+{
+    if (m_map != nullptr)
+        munmap(m_map, m_mapSize);
+
+    if (m_fd >= 0)
+        ::close(m_fd);
+
+    m_map = nullptr;
+    m_mapSize = 0;
+    m_capacity = 0;
+    m_fd = -1;
+    m_header.reset();
+}
+
+bool Leaderboard::isOpen()
+{
+    return m_map != nullptr;
+}
+
+bool Leaderboard::append(SessionRecord record)
+{
+    if (!isOpen() || !lockFile())
+        return false;
+
+    // Other processes may have appended since this one last looked
+    if (!loadHeader() || (m_header->committedRecords == m_capacity && !grow()))
+    {
+        unlockFile();
+        return false;
+    }
+
+    // Record first, past the committed end so a torn write is never visible
+    uint64_t index = m_header->committedRecords;
+    record.checksum = recordChecksum(record);
+    SessionRecord* slot = reinterpret_cast<SessionRecord*>(m_map + RECORDS_OFFSET) + index;
+    std::memcpy(slot, &record, sizeof(record));
+    bool ok = syncRange(slot, sizeof(record));
+
+    // Then the header that makes it visible
+    if (ok)
+    {
+        addToIndex(*m_header, record, index);
+        m_header->committedRecords = index + 1;
+        ok = commitHeader();
+    }
+
+    unlockFile();
+    return ok;
+}
+
+size_t Leaderboard::size()
+{
+    return isOpen() ? m_header->committedRecords : 0;
+}
+
+const SessionRecord& Leaderboard::record(size_t index)
+{
+    assert(index < size());
+    return reinterpret_cast<const SessionRecord*>(m_map + RECORDS_OFFSET)[index];
+}
+
+size_t Leaderboard::topCount()
+{
+    return isOpen() ? m_header->topCount : 0;
+}
+
+const LeaderboardEntry& Leaderboard::top(size_t rank)
+{
+    assert(rank < topCount());
+    return m_header->top[rank];
+}
+
+size_t Leaderboard::rankOf(uint64_t record)
+{
+    for (size_t rank = 0; rank < topCount(); rank++)
+    {
+        if (m_header->top[rank].record == record)
+            return rank;
+    }
+    return TOP_K;
+}
+
+const ConfigAggregate* Leaderboard::aggregate(uint64_t configHash)
+{
+    if (!isOpen())
+        return nullptr;
+
+    for (size_t i = 0; i < m_header->configCount; i++)
+    {
+        if (m_header->configs[i].configHash == configHash)
+            return &m_header->configs[i];
+    }
+    return nullptr;
+}
+
+size_t Leaderboard::aggregateCount()
+{
+    return isOpen() ? m_header->configCount : 0;
+}
+
+const ConfigAggregate& Leaderboard::aggregateAt(size_t index)
+{
+    assert(index < aggregateCount());
+    return m_header->configs[index];
+}
+
+bool Leaderboard::compact(size_t keepRecent)
+{
+    if (!isOpen() || !lockFile())
+        return false;
+
+    // Held until the new file has been renamed into place, so no append can land in the old one after it was read
+    bool ok = loadHeader() && rewrite(keepRecent);
+    unlockFile();
+
+    return ok && open(m_path);
+}
+
+bool Leaderboard::rewrite(size_t keepRecent)
+{
+    // Keep top-K records and the newest keepRecent, in their original order
+    size_t numRecords = m_header->committedRecords;
+    std::vector<bool> keep(numRecords, false);
+    for (size_t i = numRecords - std::min(numRecords, keepRecent); i < numRecords; i++)
+    {
+        keep[i] = true;
+    }
+    for (size_t rank = 0; rank < m_header->topCount; rank++)
+    {
+        keep[m_header->top[rank].record] = true;
+    }
+
+    std::vector<uint64_t> newIndex(numRecords, 0);
+    std::vector<SessionRecord> kept;
+    for (size_t i = 0; i < numRecords; i++)
+    {
+        if (keep[i])
+        {
+            newIndex[i] = kept.size();
+            kept.push_back(record(i));
+        }
+    }
+
+    Header header = *m_header;
+    header.sequence = 1;
+    header.committedRecords = kept.size();
+    for (size_t rank = 0; rank < header.topCount; rank++)
+    {
+        header.top[rank].record = newIndex[header.top[rank].record];
+    }
+    header.checksum = headerChecksum(header);
+
+    // Slot 1 stays zeroed and invalid, slot 0 is current
+    std::vector<uint8_t> headers(RECORDS_OFFSET, 0);
+    std::memcpy(headers.data(), &header, sizeof(header));
+
+    std::string tempPath = m_path + ".compact";
+    int fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+
+    size_t recordBytes = kept.size() * sizeof(SessionRecord);
+    bool ok = write(fd, headers.data(), headers.size()) == (ssize_t)headers.size()
+        && write(fd, kept.data(), recordBytes) == (ssize_t)recordBytes
+        && fsync(fd) == 0;
+    ok = (::close(fd) == 0) && ok;
+
+    if (!ok || rename(tempPath.c_str(), m_path.c_str()) != 0)
+    {
+        unlink(tempPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool Leaderboard::lockFile()
+{
+    while (true)
+    {
+        if (flock(m_fd, LOCK_EX) != 0)
+            return false;
+
+        struct stat opened, named;
+        if (fstat(m_fd, &opened) == 0 && stat(m_path.c_str(), &named) == 0
+            && opened.st_dev == named.st_dev && opened.st_ino == named.st_ino)
+        {
+            return true;
+        }
+
+        // Another process compacted the file, the one still open here is orphaned
+        int fd = ::open(m_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            unlockFile();
+            return false;
+        }
+
+        if (m_map != nullptr)
+            munmap(m_map, m_mapSize);
+        m_map = nullptr;
+        m_mapSize = 0;
+        m_capacity = 0;
+
+        ::close(m_fd); // Also drops the lock on the old file
+        m_fd = fd;
+    }
+}
+
+void Leaderboard::unlockFile()
+{
+    flock(m_fd, LOCK_UN);
+}
+
+bool Leaderboard::loadHeader()
+{
+    struct stat info;
+    if (fstat(m_fd, &info) != 0)
+        return false;
+
+    // Only a file this created is ever initialized, anything else is left alone
+    if (info.st_size == 0)
+    {
+        if (!map(MIN_CAPACITY))
+            return false;
+
+        std::memset(m_header.get(), 0, sizeof(Header));
+        m_header->magic = LEADERBOARD_MAGIC;
+        m_header->version = LEADERBOARD_VERSION;
+        m_currentSlot = 1; // So the first commit lands in slot 0
+        return commitHeader();
+    }
+
+    if ((size_t)info.st_size < RECORDS_OFFSET)
+        return false;
+
+    // Map exactly what is there, growing happens on append. Another process may have grown the file past what is mapped here.
+    size_t capacity = ((size_t)info.st_size - RECORDS_OFFSET) / sizeof(SessionRecord);
+    if ((m_map == nullptr || capacity > m_capacity) && !map(capacity))
+        return false;
+
+    // Pick the newest valid header slot
+    int best = -1;
+    bool anyOurs = false;
+    for (int slot = 0; slot < 2; slot++)
+    {
+        const Header* candidate = reinterpret_cast<const Header*>(m_map + slot * HEADER_SLOT_SIZE);
+        bool ours = candidate->magic == LEADERBOARD_MAGIC && candidate->version == LEADERBOARD_VERSION;
+        bool valid = ours && candidate->checksum == headerChecksum(*candidate)
+            && candidate->committedRecords <= m_capacity
+            && candidate->topCount <= TOP_K && candidate->configCount <= MAX_CONFIGS;
+
+        anyOurs = anyOurs || ours;
+        if (valid && (best < 0 || candidate->sequence > reinterpret_cast<const Header*>(m_map + best * HEADER_SLOT_SIZE)->sequence))
+            best = slot;
+    }
+
+    if (best < 0)
+    {
+        // Not a leaderboard, or one from another version: refuse rather than write over it.
+        // Only a leaderboard whose headers were both torn is rebuilt from its records.
+        if (!anyOurs)
+            return false;
+        return rebuildIndex();
+    }
+
+    std::memcpy(m_header.get(), m_map + best * HEADER_SLOT_SIZE, sizeof(Header));
+    m_currentSlot = best;
+    return true;
+}
+
+bool Leaderboard::map(size_t capacity)
+{
+    size_t size = RECORDS_OFFSET + capacity * sizeof(SessionRecord);
+
+    struct stat info;
+    if (fstat(m_fd, &info) != 0)
+        return false;
+    if ((size_t)info.st_size < size && ftruncate(m_fd, size) != 0)
+        return false;
+
+    if (m_map != nullptr)
+        munmap(m_map, m_mapSize);
+
+    void* address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (address == MAP_FAILED)
+    {
+        m_map = nullptr;
+        return false;
+    }
+
+    m_map = static_cast<uint8_t*>(address);
+    m_mapSize = size;
+    m_capacity = capacity;
+    return true;
+}
+
+bool Leaderboard::grow()
+{
+    return map(std::max(MIN_CAPACITY, m_capacity * 2));
+}
+
+bool Leaderboard::commitHeader()
+{
+    m_header->sequence++;
+    m_header->checksum = headerChecksum(*m_header);
+
+    int slot = 1 - m_currentSlot;
+    uint8_t* destination = m_map + slot * HEADER_SLOT_SIZE;
+    std::memcpy(destination, m_header.get(), sizeof(Header));
+    if (!syncRange(destination, sizeof(Header)))
+        return false;
+
+    m_currentSlot = slot;
+    return true;
+}
+
+bool Leaderboard::rebuildIndex()
+{
+    // Both headers are unreadable. Every record up to the first bad checksum is
+    // trusted, which loses at most the commit that was in flight.
+    std::memset(m_header.get(), 0, sizeof(Header));
+    m_header->magic = LEADERBOARD_MAGIC;
+    m_header->version = LEADERBOARD_VERSION;
+
+    const SessionRecord* records = reinterpret_cast<const SessionRecord*>(m_map + RECORDS_OFFSET);
+    uint64_t count = 0;
+    while (count < m_capacity && records[count].checksum == recordChecksum(records[count])
+        && records[count].finishedAt != 0)
+    {
+        addToIndex(*m_header, records[count], count);
+        count++;
+    }
+
+    m_header->committedRecords = count;
+    m_currentSlot = 1;
+    return commitHeader();
+}
+
+void Leaderboard::addToIndex(Header& header, const SessionRecord& record, uint64_t index)
+{
+    // Top-K stays sorted by score, ties go to whoever got there first
+    size_t position = header.topCount;
+    while (position > 0 && header.top[position - 1].score < record.score)
+    {
+        position--;
+    }
+
+    if (position < TOP_K)
+    {
+        size_t last = std::min((size_t)header.topCount, TOP_K - 1);
+        std::memmove(&header.top[position + 1], &header.top[position], (last - position) * sizeof(LeaderboardEntry));
+        header.top[position] = { record.score, index };
+        header.topCount = std::min(header.topCount + 1, (uint32_t)TOP_K);
+    }
+
+    ConfigAggregate* aggregate = nullptr;
+    for (size_t i = 0; i < header.configCount; i++)
+    {
+        if (header.configs[i].configHash == record.configHash)
+        {
+            aggregate = &header.configs[i];
+            break;
+        }
+    }
+
+    if (aggregate == nullptr)
+    {
+        if (header.configCount == MAX_CONFIGS)
+            return;
+
+        aggregate = &header.configs[header.configCount++];
+        *aggregate = { record.configHash, 0, 0, INT64_MIN, 0, 0 };
+    }
+
+    aggregate->sessions++;
+    aggregate->totalScore += record.score;
+    aggregate->bestScore = std::max(aggregate->bestScore, record.score);
+    aggregate->totalDuration_ms += record.duration_ms;
+    aggregate->totalStrikes += record.strikes;
+}
@@ -3,10 +3,39 @@
 #include <SDL2/SDL_mixer.h>
 
 #include "utils.h"
+#include "assets.h"
+#include "bot.h"
+#include "concurrency.h"
+#include "leaderboard.h"
+#include "rewind.h"
 #include "shrinky.h"
+#include "view.h"
+
+#include <atomic>
+#include <cstdio>
+#include <memory>
 
 using namespace std::chrono_literals;
 
+// Simulation runs at a fixed rate regardless of how long presenting a frame takes
+static constexpr const float SIM_TICK_MS = 1000.0f / 240.0f;
+
+// Practice mode keeps a minute of snapshots, one every 6 ticks, and rewinds a second per key press
+static constexpr const uint64_t SNAPSHOT_INTERVAL_TICKS = 6;
+static constexpr const size_t REWIND_CAPACITY = 60 * 240 / SNAPSHOT_INTERVAL_TICKS;
+static constexpr const size_t REWIND_STEPS = 240 / SNAPSHOT_INTERVAL_TICKS;
+
+// Game is saved to disk about once a second so it can be resumed after a crash
+static constexpr const uint64_t AUTOSAVE_INTERVAL_TICKS = 240;
+
+// Bots act at roughly human speed
+static constexpr const auto BOT_STEP_INTERVAL = 50ms;
+
+// One command queue per agent, agent 0 is the local player
+using AgentQueue = MpscQueue<PlayerAction, 64>;
+using AgentQueues = std::vector<std::unique_ptr<AgentQueue>>;
+using SnapshotBuffer = TripleBuffer<GameSnapshot>;
+
 void drawGameOver(TTF_Font* font, SDL_Renderer* renderer)
 {
 	SDL_Rect rect{};
@@ -23,6 +52,26 @@ void drawGameOver(TTF_Font* font, SDL_Renderer* renderer)
 	SDL_RenderCopy(renderer, texture, nullptr, &rect);
 }
 
+void drawBest(int64_t bestScore, TTF_Font* font, SDL_Renderer* renderer)
+{
+	std::string bestStr = "BEST " + std::to_string(bestScore);
+
+	SDL_Rect rect{};
+	SDL_Surface* surface = TTF_RenderText_Solid(font, bestStr.c_str(), {0xFF, 0xFF, 0xFF, 0xFF});
+	SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer, surface);
+
+	int width, height;
+	SDL_QueryTexture(texture, nullptr, nullptr, &width, &height);
+	rect.x = 10;
+	rect.y = WINDOW_HEIGHT - height - 10;
+	rect.w = width;
+	rect.h = height;
+
+	SDL_RenderCopy(renderer, texture, nullptr, &rect);
+	SDL_DestroyTexture(texture);
+	SDL_FreeSurface(surface);
+}
+
 void drawStrikes(uint8_t numStrikes, TTF_Font* font, SDL_Renderer* renderer, uint32_t topLeftX, uint32_t topLeftY)
 {
 	std::string strikeStr = "";
@@ -45,145 +94,429 @@ void drawStrikes(uint8_t numStrikes, TTF_Font* font, SDL_Renderer* renderer, uin
 	SDL_RenderCopy(renderer, texture, nullptr, &rect);
 }
 
+void serializeGame(Game& game, GameState& state, std::vector<uint8_t>& bytes)
+{
+	game.save(state);
+	state.serialize(bytes);
+}
+
+/*
+ * botSnapshots is nullptr when there are no bots, rewindBuffer is nullptr
+ * outside of practice mode and savePath is empty if there is nowhere to save to
+ */
+void simulationLoop(Game& game, AgentQueues& queues, SnapshotBuffer& snapshots, SnapshotBuffer* botSnapshots, RewindBuffer* rewindBuffer,
+	std::string savePath, std::atomic<bool>& running, std::atomic<bool>& gameOver)
+{
+	GameState state;
+	std::vector<uint8_t> stateBytes;
+	std::vector<uint8_t> saveBytes;
+
+	// Autosaves are written off this thread, an fsync can take longer than many ticks
+	std::unique_ptr<SaveWriter> saveWriter;
+	if (!savePath.empty())
+		saveWriter = std::make_unique<SaveWriter>(savePath);
+
+	auto tickDuration = std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(
+		std::chrono::duration<float, std::chrono::milliseconds::period>(SIM_TICK_MS));
+	auto nextTick = std::chrono::high_resolution_clock::now();
+
+	while (running)
+	{
+		// Apply everything forwarded since the last tick, always in agent order so ticks are deterministic
+		PlayerAction action;
+		for (size_t agent = 0; agent < queues.size(); agent++)
+		{
+			while (queues[agent]->pop(action))
+			{
+				if (action == PlayerAction::REWIND)
+				{
+					if (agent == 0 && rewindBuffer != nullptr && rewindBuffer->rewind(REWIND_STEPS, stateBytes) && state.deserialize(stateBytes))
+					{
+						game.load(state);
+					}
+					continue;
+				}
+
+				game.apply(agent, action);
+			}
+		}
+
+		game.update(SIM_TICK_MS);
+
+		if (rewindBuffer != nullptr && game.tick() % SNAPSHOT_INTERVAL_TICKS == 0)
+		{
+			game.save(state);
+			state.serialize(stateBytes);
+			rewindBuffer->push(game.tick(), stateBytes);
+		}
+
+		if (saveWriter != nullptr && game.tick() % AUTOSAVE_INTERVAL_TICKS == 0)
+		{
+			serializeGame(game, state, saveBytes);
+			saveWriter->submit(saveBytes);
+		}
+
+		game.snapshot(snapshots.writeBuffer());
+		snapshots.publish();
+
+		if (botSnapshots != nullptr)
+		{
+			game.snapshot(botSnapshots->writeBuffer());
+			botSnapshots->publish();
+		}
+
+		if (game.isOver())
+		{
+			// Nothing left to resume
+			if (saveWriter != nullptr)
+			{
+				saveWriter->stop();
+				std::remove(savePath.c_str());
+			}
+
+			gameOver = true;
+			return;
+		}
+
+		// Fixed rate; if a tick ran long the next ones run back to back to catch up
+		nextTick += tickDuration;
+		std::this_thread::sleep_until(nextTick);
+	}
+
+	// Quit mid-game, save so the next launch can pick up exactly here
+	if (saveWriter != nullptr)
+	{
+		saveWriter->stop();
+		serializeGame(game, state, saveBytes);
+		writeSaveFile(savePath, saveBytes);
+	}
+}
+
+/*
+ * Drives agents firstBot and up from one thread. Hundreds of bots cost one
+ * scan for full cells per step plus a queue push each.
+ */
+void botLoop(size_t firstBot, AgentQueues& queues, SnapshotBuffer& snapshots, std::atomic<bool>& running)
+{
+	std::vector<GridPosition> fullCells;
+
+	while (running)
+	{
+		snapshots.fetch();
+		const GameSnapshot& snapshot = snapshots.readBuffer();
+
+		fullCells.clear();
+		for (size_t i = 0; i < snapshot.cellFullness.size(); i++)
+		{
+			if (snapshot.cellFullness[i] > 0.0f)
+				fullCells.push_back(GridPosition(i / snapshot.gridWidth, i % snapshot.gridWidth));
+		}
+
+		PlayerAction action;
+		for (size_t agent = firstBot; agent < queues.size(); agent++)
+		{
+			if (chooseBotAction(snapshot, fullCells, agent, action))
+				queues[agent]->push(action);
+		}
+
+		std::this_thread::sleep_for(BOT_STEP_INTERVAL);
+	}
+}
+
+/*
+ * Adds a finished game to the leaderboard and prints where it placed
+ */
+void recordSession(Leaderboard& leaderboard, Game& game, uint64_t configHash)
+{
+	GameState state;
+	game.save(state);
+
+	SessionRecord record;
+	record.score = state.score;
+	record.duration_ms = state.totalTimeElapsed_ms;
+	record.configHash = configHash;
+	record.seed = state.seed;
+	record.finishedAt = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	record.strikes = state.strikes;
+
+	if (!leaderboard.append(record))
+	{
+		std::cerr << "Failed to save score to the leaderboard" << std::endl;
+		return;
+	}
+
+	size_t rank = leaderboard.rankOf(leaderboard.size() - 1);
+	if (rank < Leaderboard::TOP_K)
+		std::cout << "Score " << record.score << " is #" << rank + 1 << " on the leaderboard" << std::endl;
+
+	for (size_t i = 0; i < std::min<size_t>(5, leaderboard.topCount()); i++)
+	{
+		std::cout << "  " << i + 1 << ". " << leaderboard.top(i).score << std::endl;
+	}
+}
+
+/*
+ * bestScore is the best ever score under the current config, or -1 if there is none yet
+ */
+void renderLoop(SDL_Window* window, TTF_Font* gameFont, SnapshotBuffer& snapshots, std::atomic<bool>& running,
+	std::chrono::high_resolution_clock::time_point launchTime, int64_t bestScore)
+{
+	// The renderer is created and used only on this thread
+	SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_PRESENTVSYNC);
+
+	GridView gridView(config.gridWidth_cells, config.gridHeight_cells);
+	Score totalScore(gameFont, {10, 10});
+	Score playerScore(gameFont, {10, 50}); // Only shown when playing with bots
+	bool firstFramePresented = false;
+
+	while (running)
+	{
+		// Nothing to draw until the simulation has published its first snapshot
+		if (!snapshots.fetch() && !firstFramePresented)
+		{
+			std::this_thread::sleep_for(1ms);
+			continue;
+		}
+
+		const GameSnapshot& snapshot = snapshots.readBuffer();
+		gridView.setSnapshot(&snapshot);
+		totalScore.setScore(snapshot.score);
+		if (!snapshot.agentScores.empty())
+			playerScore.setScore(snapshot.agentScores[0]);
+
+		// Clear the window to black
+		SDL_SetRenderDrawColor(renderer, 0x0, 0x0, 0x0, 0xFF);
+		SDL_RenderClear(renderer);
+
+		gridView.draw(renderer);
+		totalScore.draw(renderer);
+		if (snapshot.agentScores.size() > 1)
+			playerScore.draw(renderer);
+		drawStrikes(std::min(MAX_STRIKES, snapshot.strikes), gameFont, renderer, 0.9 * WINDOW_WIDTH, 10);
+		if (bestScore >= 0)
+			drawBest(std::max(bestScore, snapshot.score), gameFont, renderer);
+
+		if (snapshot.gameOver)
+		{
+			drawGameOver(gameFont, renderer);
+		}
+
+		// Present the backbuffer
+		SDL_RenderPresent(renderer);
+
+		if (!firstFramePresented)
+		{
+			firstFramePresented = true;
+			auto firstFrameTime = std::chrono::high_resolution_clock::now();
+			std::cout << "Launch to first frame: "
+				<< std::chrono::duration<float, std::chrono::milliseconds::period>(firstFrameTime - launchTime).count()
+				<< " ms" << std::endl;
+		}
+	}
+
+	SDL_DestroyRenderer(renderer);
+}
+
 int main(int argc, char** argv)
 {
+	auto launchTime = std::chrono::high_resolution_clock::now();
+
+	// --practice enables rewinding with BACKSPACE, --resume continues the last unfinished game,
+	// --bots N adds N bot drainers and --grid N plays on an N by N grid
+	bool practiceMode = false;
+	bool resume = false;
+	size_t numBots = 0;
+	uint32_t gridSize = config.gridWidth_cells;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--practice")
+			practiceMode = true;
+		else if (arg == "--resume")
+			resume = true;
+		else if (arg == "--bots" && i + 1 < argc)
+			numBots = std::strtoul(argv[++i], nullptr, 10);
+		else if (arg == "--grid" && i + 1 < argc)
+			gridSize = std::strtoul(argv[++i], nullptr, 10);
+	}
+
+	if (gridSize < 1 || gridSize > 100)
+	{
+		std::cerr << "Grid size must be between 1 and 100" << std::endl;
+		return 1;
+	}
+	config.setGridSize(gridSize, gridSize);
+
     // Initialize SDL components
 	SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
     TTF_Init();
 
 	SDL_Window* window = SDL_CreateWindow("Shrinky", 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_SHOWN);
-	SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, 0); 
 
-    // Initialize the font
-	TTF_Font* gameFont = TTF_OpenFont("fonts/DejaVuSansMono.ttf", 32);
-	Score score(gameFont, {20, 20});
+    // Initialize the font from the packed assets
+	TTF_Font* gameFont = TTF_OpenFontRW(openAsset("fonts/DejaVuSansMono.ttf"), 1, 32);
+	if (gameFont == nullptr)
+	{
+		std::cerr << "Failed to load font: " << SDL_GetError() << std::endl;
+		return 1;
+	}
 
 	// Initialize sound
 	// Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 2048);
-	// Mix_Chunk* wallHitSound = Mix_LoadWAV("audio/pongWallHit.wav");
-	// Mix_Chunk* paddleHitSound = Mix_LoadWAV("audio/pongPaddleHit.wav");
+	// Mix_Chunk* wallHitSound = Mix_LoadWAV_RW(openAsset("audio/pongWallHit.wav"), 1);
+	// Mix_Chunk* paddleHitSound = Mix_LoadWAV_RW(openAsset("audio/pongPaddleHit.wav"), 1);
 
-    // Create Drainer and Grid
-	Drainer drainer(0, 0, config.gridWidth_cells, config.gridHeight_cells);
-    Grid grid(config.gridWidth_cells, config.gridHeight_cells, drainer);
-	Score totalScore(gameFont, {10, 10});
+	std::string savePath;
+	Leaderboard leaderboard;
+	char* prefPath = SDL_GetPrefPath("lanbas", "shrinky");
+	if (prefPath != nullptr)
+	{
+		savePath = std::string(prefPath) + "shrinky.sav";
 
-	auto globalStartTime = std::chrono::high_resolution_clock::now();
-	auto now = std::chrono::high_resolution_clock::now();
-	auto totalTimeElapsed_ms = std::chrono::duration<float, std::chrono::milliseconds::period>(now - globalStartTime).count();
-	float lastFillTime_ms = 0.0f;
-	float lastFillPeriodUpdate_ms = 0.0f;
-	float lastDrainRatePeriodUpdate_ms = 0.0f;
-	uint8_t strikes = 0;
-	bool gameOver = false;
+		auto leaderboardStart = std::chrono::high_resolution_clock::now();
+		if (leaderboard.open(std::string(prefPath) + "leaderboard.dat"))
+		{
+			std::cout << "Leaderboard of " << leaderboard.size() << " sessions loaded in "
+				<< std::chrono::duration<float, std::chrono::microseconds::period>(std::chrono::high_resolution_clock::now() - leaderboardStart).count()
+				<< " us" << std::endl;
+		}
 
-    // Game logic
-    {
-        bool running = true;
-		float dt = 0.0f;
+		SDL_free(prefPath);
+	}
 
-        // Continue looping and processing events until user exits
-		while (running)
+	// A resumed game keeps the grid size and bots it was saved with, whatever the flags say
+	GameState resumeState;
+	bool resumed = false;
+	if (resume)
+	{
+		std::vector<uint8_t> stateBytes;
+		if (savePath.empty() || !readSaveFile(savePath, stateBytes))
+		{
+			std::cerr << "No saved game to resume, starting a new one" << std::endl;
+		}
+		else if (!resumeState.deserialize(stateBytes) || resumeState.drainerPositions.empty()
+			|| resumeState.gridWidth < 1 || resumeState.gridWidth > 100 || resumeState.gridHeight < 1 || resumeState.gridHeight > 100)
+		{
+			// Starting a new game would autosave over it
+			std::cerr << "Saved game in " << savePath << " could not be loaded, not starting so it is not overwritten" << std::endl;
+			return 1;
+		}
+		else
 		{
-			auto startTime = std::chrono::high_resolution_clock::now();
-			SDL_Event event;
-			float score = 0.0f;
+			config.setGridSize(resumeState.gridWidth, resumeState.gridHeight);
+			numBots = resumeState.drainerPositions.size() - 1;
+			resumed = true;
+		}
+	}
 
-			while (SDL_PollEvent(&event))
-			{
-				if (event.type == SDL_QUIT)
-				{
-					running = false;
-				}
-				
-				// Check which buttons are down/up
-				else if (event.type == SDL_KEYDOWN)
-				{
-					switch(event.key.keysym.sym)
-					{
-						case SDLK_ESCAPE:
-							running = false;
-							break;
-						case SDLK_SPACE:
-						{
-							GridPosition drainerPosition = drainer.position(); 
-							bool wasFull = grid.drainCell(drainerPosition.row, drainerPosition.col, score);
-							totalScore.addScore((int)score);
-							if (!wasFull)
-							{
-								strikes++;
-							}
-							break;
-						}
-						case SDLK_DOWN:
-							drainer.move(PlayerMove::DOWN);
-							break;
-						case SDLK_UP:
-							drainer.move(PlayerMove::UP);
-							break;
-						case SDLK_LEFT:
-							drainer.move(PlayerMove::LEFT);
-							break;
-						case SDLK_RIGHT:
-							drainer.move(PlayerMove::RIGHT);
-							break;
-					}
-				}
-			}
+	// Game state is owned by the simulation thread, the render thread only sees snapshots of it
+	Game game(resumed ? resumeState.seed : static_cast<uint32_t>(std::chrono::high_resolution_clock::now().time_since_epoch().count()), 1 + numBots);
+	if (resumed && !game.load(resumeState))
+	{
+		std::cerr << "Saved game in " << savePath << " could not be loaded, not starting so it is not overwritten" << std::endl;
+		return 1;
+	}
 
-			// Update fill frequency and rate
-			if (totalTimeElapsed_ms - lastFillPeriodUpdate_ms > config.fillIntervalDeltaPeriod_ms)
-			{
-				lastFillPeriodUpdate_ms = totalTimeElapsed_ms;
-				config.fillInterval_ms = std::max(config.fillIntervalMin_ms, config.fillInterval_ms - config.fillIntervalDelta_ms);
-			}
+	// Practice games can rewind, so they are kept off the leaderboard, and a game resumed from practice stays one
+	if (practiceMode)
+		game.markPractice();
+	practiceMode = game.isPractice();
 
-			if (totalTimeElapsed_ms - lastDrainRatePeriodUpdate_ms > config.drainRateDeltaPeriod_ms)
-			{
-				lastDrainRatePeriodUpdate_ms = totalTimeElapsed_ms;
-				config.drainRate = std::min(config.drainRateMax, config.drainRate + config.drainRateDelta);
-			}
+	uint64_t configHash = config.hash(game.numAgents());
+	bool recordScore = leaderboard.isOpen() && !practiceMode;
+	const ConfigAggregate* aggregate = leaderboard.aggregate(configHash);
+	int64_t bestScore = recordScore ? (aggregate != nullptr ? aggregate->bestScore : 0) : -1;
 
-			// If enough time has passed, fill a cell on the grid
-			if (totalTimeElapsed_ms - lastFillTime_ms > config.fillInterval_ms)
-			{
-				lastFillTime_ms = totalTimeElapsed_ms;
-				grid.fillCell(config.drainRate);
-			}
+	std::unique_ptr<RewindBuffer> rewindBuffer;
+	if (practiceMode)
+		rewindBuffer = std::make_unique<RewindBuffer>(REWIND_CAPACITY, SNAPSHOT_INTERVAL_TICKS);
+
+	AgentQueues queues;
+	for (size_t i = 0; i < game.numAgents(); i++)
+	{
+		queues.push_back(std::make_unique<AgentQueue>());
+	}
+	AgentQueue& inputs = *queues[0];
 
-            // Clear the window to black
-			SDL_SetRenderDrawColor(renderer, 0x0, 0x0, 0x0, 0xFF);
-			SDL_RenderClear(renderer);
+	SnapshotBuffer snapshots;
+	std::unique_ptr<SnapshotBuffer> botSnapshots;
+	if (numBots > 0)
+		botSnapshots = std::make_unique<SnapshotBuffer>();
 
-			// Update and draw game
-			strikes += grid.update(dt);
+	std::atomic<bool> running{ true };
+	std::atomic<bool> gameOver{ false };
 
-			// Draw grid()
-			grid.draw(renderer);
-			totalScore.draw(renderer);
-			drawStrikes(std::min(3, (int)strikes), gameFont, renderer, 0.9 * WINDOW_WIDTH, 10);
+	std::thread simulationThread(simulationLoop, std::ref(game), std::ref(queues), std::ref(snapshots), botSnapshots.get(), rewindBuffer.get(),
+		savePath, std::ref(running), std::ref(gameOver));
+	std::thread renderThread(renderLoop, window, gameFont, std::ref(snapshots), std::ref(running), launchTime, bestScore);
+	std::thread botThread;
+	if (numBots > 0)
+		botThread = std::thread(botLoop, 1, std::ref(queues), std::ref(*botSnapshots), std::ref(running));
+
+    // Input handling stays on the main thread, SDL requires events to be pumped here
+    {
+		SDL_Event event;
+
+        // Continue looping and processing events until user exits or the game ends
+		while (running && !gameOver)
+		{
+			if (!SDL_WaitEventTimeout(&event, 10))
+				continue;
 
-			if (strikes >= 3)
+			if (event.type == SDL_QUIT)
 			{
 				running = false;
-				gameOver = true;
-				drawGameOver(gameFont, renderer);
 			}
-
-			// Present the backbuffer
-			SDL_RenderPresent(renderer);
-
-            // Calculate frame time
-			auto stopTime = std::chrono::high_resolution_clock::now();
-			dt = std::chrono::duration<float, std::chrono::milliseconds::period>(stopTime - startTime).count();
-			totalTimeElapsed_ms += dt;
-        }
+			
+			// Check which buttons are down/up
+			else if (event.type == SDL_KEYDOWN)
+			{
+				switch(event.key.keysym.sym)
+				{
+					case SDLK_ESCAPE:
+						running = false;
+						break;
+					case SDLK_SPACE:
+						inputs.push(PlayerAction::DRAIN);
+						break;
+					case SDLK_BACKSPACE:
+						if (practiceMode)
+							inputs.push(PlayerAction::REWIND);
+						break;
+					case SDLK_DOWN:
+						inputs.push(PlayerAction::MOVE_DOWN);
+						break;
+					case SDLK_UP:
+						inputs.push(PlayerAction::MOVE_UP);
+						break;
+					case SDLK_LEFT:
+						inputs.push(PlayerAction::MOVE_LEFT);
+						break;
+					case SDLK_RIGHT:
+						inputs.push(PlayerAction::MOVE_RIGHT);
+						break;
+				}
+			}
+		}
 
 		if (gameOver)
+		{
+			// The simulation thread has finished with the game, so it is safe to read here
+			simulationThread.join();
+			if (recordScore)
+				recordSession(leaderboard, game, configHash);
+
+			// Leave the final frame with GAME OVER up for a bit
 			std::this_thread::sleep_for(5s);
+		}
     }
 
+	running = false;
+	if (simulationThread.joinable())
+		simulationThread.join();
+	renderThread.join();
+	if (botThread.joinable())
+		botThread.join();
+
     return 0;
 }
-// To spawn:
-    // Add object to shared obsctacle list at whatever the 
@@ -0,0 +1,307 @@
+#include "rewind.h"
+
+#include <cstdio>
+#include <unistd.h>
+
+// Zero runs shorter than this are cheaper to leave inside a literal than to end it
+static constexpr const size_t MIN_ZERO_RUN = 3;
+
+static void writeVarint(std::vector<uint8_t>& out, size_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static size_t readVarint(const std::vector<uint8_t>& in, size_t& offset)
+{
+    size_t value = 0;
+    for (int shift = 0; offset < in.size(); shift += 7)
+    {
+        uint8_t byte = in[offset++];
+        value |= static_cast<size_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            break;
+    }
+    return value;
+}
+
+////////////////////////////////
+// RewindBuffer
+////////////////////////////////
+RewindBuffer::RewindBuffer(size_t capacity, uint64_t snapshotInterval, size_t keyframeInterval)
+    : m_entries(capacity), m_snapshotInterval(snapshotInterval), m_keyframeInterval(keyframeInterval)
+{
+    assert(capacity > 0);
+    assert(snapshotInterval > 0);
+    assert(keyframeInterval > 0);
+}
+
+void RewindBuffer::push(uint64_t tick, const std::vector<uint8_t>& state)
+{
+    if (m_count == m_entries.size())
+    {
+        // The oldest entry is always a keyframe. Promote its successor to one
+        // before dropping it so the remaining deltas still have a base.
+        if (m_count > 1 && !entryAt(1).keyframe)
+        {
+            reconstruct(1, m_scratch);
+            encodeDelta({}, m_scratch, entryAt(1).delta);
+            entryAt(1).keyframe = true;
+        }
+
+        m_oldest = (m_oldest + 1) % m_entries.size();
+        m_count--;
+    }
+
+    bool keyframe = m_count == 0 || m_sinceKeyframe + 1 >= m_keyframeInterval;
+
+    m_count++;
+    Entry& entry = entryAt(m_count - 1);
+    entry.tick = tick;
+    entry.keyframe = keyframe;
+    entry.stateSize = state.size();
+    encodeDelta(keyframe ? std::vector<uint8_t>() : m_newest, state, entry.delta);
+
+    m_sinceKeyframe = keyframe ? 0 : m_sinceKeyframe + 1;
+    m_newest = state;
+}
+
+bool RewindBuffer::rewind(size_t steps, std::vector<uint8_t>& out)
+{
+    if (m_count == 0)
+        return false;
+
+    size_t target = m_count - 1 - std::min(steps, m_count - 1);
+    reconstruct(target, out);
+
+    m_count = target + 1;
+    m_newest = out;
+
+    m_sinceKeyframe = 0;
+    for (size_t i = target; !entryAt(i).keyframe; i--)
+    {
+        m_sinceKeyframe++;
+    }
+
+    return true;
+}
+
+bool RewindBuffer::seek(uint64_t tick, std::vector<uint8_t>& out)
+{
+    if (m_count == 0 || tick < entryAt(0).tick)
+        return false;
+
+    // Snapshots are evenly spaced so the entry can be found directly
+    size_t index = std::min<uint64_t>((tick - entryAt(0).tick) / m_snapshotInterval, m_count - 1);
+    while (index > 0 && entryAt(index).tick > tick)
+    {
+        index--;
+    }
+
+    reconstruct(index, out);
+    return true;
+}
+
+size_t RewindBuffer::size()
+{
+    return m_count;
+}
+
+size_t RewindBuffer::memoryUsage()
+{
+    size_t total = 0;
+    for (size_t i = 0; i < m_count; i++)
+    {
+        total += entryAt(i).delta.size();
+    }
+    return total;
+}
+
+RewindBuffer::Entry& RewindBuffer::entryAt(size_t index)
+{
+    assert(index < m_count);
+    return m_entries[(m_oldest + index) % m_entries.size()];
+}
+
+void RewindBuffer::reconstruct(size_t index, std::vector<uint8_t>& out)
+{
+    // Walk back to the nearest keyframe, at most keyframeInterval entries
+    size_t start = index;
+    while (!entryAt(start).keyframe)
+    {
+        start--;
+    }
+
+    out.clear();
+    for (size_t i = start; i <= index; i++)
+    {
+        applyDelta(entryAt(i).delta, entryAt(i).stateSize, out);
+    }
+}
+
+void RewindBuffer::encodeDelta(const std::vector<uint8_t>& base, const std::vector<uint8_t>& state, std::vector<uint8_t>& out)
+{
+    // Stream of [zero run length][literal length][literal bytes] over state XOR base,
+    // with base treated as zero padded to the size of state
+    auto xorAt = [&](size_t i) -> uint8_t
+    {
+        return state[i] ^ (i < base.size() ? base[i] : 0);
+    };
+
+    out.clear();
+    size_t n = state.size();
+    size_t i = 0;
+    while (i < n)
+    {
+        size_t zeroRun = 0;
+        while (i + zeroRun < n && xorAt(i + zeroRun) == 0)
+        {
+            zeroRun++;
+        }
+        i += zeroRun;
+
+        // Extend the literal until a worthwhile zero run or the end
+        size_t literalEnd = i;
+        while (literalEnd < n)
+        {
+            size_t zeros = 0;
+            while (literalEnd + zeros < n && zeros < MIN_ZERO_RUN && xorAt(literalEnd + zeros) == 0)
+            {
+                zeros++;
+            }
+
+            if (zeros == MIN_ZERO_RUN || literalEnd + zeros == n)
+                break;
+
+            literalEnd += zeros + 1;
+        }
+
+        writeVarint(out, zeroRun);
+        writeVarint(out, literalEnd - i);
+        for (; i < literalEnd; i++)
+        {
+            out.push_back(xorAt(i));
+        }
+    }
+}
+
+void RewindBuffer::applyDelta(const std::vector<uint8_t>& delta, size_t stateSize, std::vector<uint8_t>& inOut)
+{
+    inOut.resize(stateSize, 0);
+
+    size_t offset = 0;
+    size_t i = 0;
+    while (offset < delta.size() && i < stateSize)
+    {
+        i += readVarint(delta, offset);
+        size_t literalLength = readVarint(delta, offset);
+        for (size_t j = 0; j < literalLength && i < stateSize && offset < delta.size(); j++)
+        {
+            inOut[i++] ^= delta[offset++];
+        }
+    }
+}
+
+////////////////////////////////
+// Save files
+////////////////////////////////
+bool writeSaveFile(const std::string& path, const std::vector<uint8_t>& bytes)
+{
+    std::string tempPath = path + ".tmp";
+    FILE* file = std::fopen(tempPath.c_str(), "wb");
+    if (file == nullptr)
+        return false;
+
+    bool ok = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size()
+        && std::fflush(file) == 0
+        && fsync(fileno(file)) == 0;
+    ok = (std::fclose(file) == 0) && ok;
+
+    if (!ok || std::rename(tempPath.c_str(), path.c_str()) != 0)
+    {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool readSaveFile(const std::string& path, std::vector<uint8_t>& out)
+{
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        return false;
+
+    out.clear();
+    uint8_t buffer[4096];
+    size_t numRead;
+    while ((numRead = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        out.insert(out.end(), buffer, buffer + numRead);
+    }
+
+    bool ok = std::ferror(file) == 0;
+    std::fclose(file);
+    return ok;
+}
+
+////////////////////////////////
+// SaveWriter
+////////////////////////////////
+SaveWriter::SaveWriter(const std::string& path)
+    : m_path(path)
+    , m_thread(&SaveWriter::run, this)
+{
+}
+
+SaveWriter::~SaveWriter()
+{
+    stop();
+}
+
+void SaveWriter::submit(std::vector<uint8_t>& bytes)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.swap(bytes);
+        m_hasPending = true;
+    }
+    m_wake.notify_one();
+}
+
+void SaveWriter::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_one();
+
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void SaveWriter::run()
+{
+    std::vector<uint8_t> writing;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        m_wake.wait(lock, [this] { return m_hasPending || m_stopping; });
+        if (m_stopping)
+            return;
+
+        writing.swap(m_pending);
+        m_hasPending = false;
+
+        lock.unlock();
+        if (!writeSaveFile(m_path, writing))
+            std::cerr << "Failed to save game to " << m_path << std::endl;
+        lock.lock();
+    }
+}
@@ -1,5 +1,45 @@
 #include "shrinky.h"
-#include "SDL2/SDL2_gfxPrimitives.h"
+
+#include <algorithm>
+#include <cstring>
+
+GameConfigurations config;
+
+void GameConfigurations::setGridSize(uint32_t width, uint32_t height)
+{
+    assert(width > 0 && width <= INT8_MAX);
+    assert(height > 0 && height <= INT8_MAX);
+
+    gridWidth_cells = width;
+    gridHeight_cells = height;
+    cellWidth_px = gridWidth_px / gridWidth_cells;
+    cellHeight_px = gridHeight_px / gridHeight_cells;
+}
+
+uint64_t GameConfigurations::hash(size_t numAgents) const
+{
+    // Only what changes how a game plays, pixel sizes do not matter
+    float values[] = {
+        fillInterval_ms, fillIntervalDelta_ms, fillIntervalDeltaPeriod_ms, fillIntervalMin_ms,
+        drainRate, drainRateDelta, drainRateDeltaPeriod_ms, drainRateMax, drainRateVariation
+    };
+    uint64_t integers[] = { gridWidth_cells, gridHeight_cells, numAgents };
+
+    // FNV-1a
+    uint64_t result = 0xcbf29ce484222325ull;
+    auto mix = [&](const void* data, size_t size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++)
+        {
+            result ^= bytes[i];
+            result *= 0x100000001b3ull;
+        }
+    };
+    mix(values, sizeof(values));
+    mix(integers, sizeof(integers));
+    return result;
+}
 
 ////////////////////////////////
 // Drainer
@@ -37,6 +77,13 @@ GridPosition Drainer::position()
     return m_position;
 }
 
+void Drainer::setPosition(GridPosition position)
+{
+    assert(position.row >= 0 && position.row < m_gridHeight);
+    assert(position.col >= 0 && position.col < m_gridWidth);
+    m_position = position;
+}
+
 
 ////////////////////////////////
 // Cellwaaw
@@ -69,14 +116,24 @@ void Cell::update(float dt)
     m_proportionFilled = std::max(0.0f, m_proportionFilled - ((dt / 1000.0f) * m_shrinkRate));
 }
 
+CellState Cell::state()
+{
+    return { m_proportionFilled, m_shrinkRate };
+}
+
+void Cell::restore(const CellState& state)
+{
+    m_proportionFilled = state.proportionFilled;
+    m_shrinkRate = state.shrinkRate;
+}
+
 ////////////////////////////////
-// Grid : IDrawable
+// Grid
 ////////////////////////////////
-Grid::Grid(uint8_t width, uint8_t height, Drainer& drainer)
-    : m_drainer(drainer)
+Grid::Grid(uint8_t width, uint8_t height, std::vector<Drainer>& drainers, uint32_t seed)
+    : m_rngState(seed == 0 ? 0x9E3779B9 : seed), m_drainers(drainers) // xorshift state must never be zero
 {
     m_grid = std::vector<std::vector<Cell>>(height, std::vector<Cell>(width));
-    m_drawGrid = std::vector<std::vector<SDL_Rect>>(height, std::vector<SDL_Rect>(width));
 
     for (int i = 0; i < height; i++)
     {
@@ -84,13 +141,6 @@ Grid::Grid(uint8_t width, uint8_t height, Drainer& drainer)
         {
             // Set available cells
             m_availableCells.push_back(GridPosition(i, j));
-
-            // Intialize known pixel positions of cells
-            m_drawGrid[i][j] = SDL_Rect();
-            m_drawGrid[i][j].h = config.cellHeight_px;
-            m_drawGrid[i][j].w = config.cellWidth_px;
-            m_drawGrid[i][j].x = config.gridOriginX_px + (j * config.cellWidth_px);
-            m_drawGrid[i][j].y = config.gridOriginY_px + (i * config.cellHeight_px);
         }
     }
 }
@@ -116,7 +166,10 @@ void Grid::fillCell(float shrinkRate)
 {
     // Randomly select cell for filling
     size_t numAvailable = m_availableCells.size();
-    int idx = rand() % (numAvailable - 1);
+    if (numAvailable == 0)
+        return;
+
+    size_t idx = nextRandom() % numAvailable;
     GridPosition chosen = m_availableCells[idx];
 
     // Fill cell in grid
@@ -152,54 +205,480 @@ uint8_t Grid::update(float dt)
     return missedCells;
 }
 
-void Grid::draw(SDL_Renderer* renderer)
+void Grid::snapshot(GameSnapshot& out)
 {
-    // Draw all cells based on their fullness
-    // Current drainer position cell should be outlined in color
+    out.gridHeight = m_grid.size();
+    out.gridWidth = m_grid.empty() ? 0 : m_grid[0].size();
 
-    // For each cell
-    int lineThickness = 8;
-    uint8_t i = 0;
-    for (uint32_t y = 0; y < config.gridHeight_px; y += config.cellHeight_px)
+    // resize() keeps the snapshot's allocation once it has been sized
+    out.cellFullness.resize(out.gridHeight * out.gridWidth);
+    for (size_t i = 0; i < m_grid.size(); i++)
     {
-        uint8_t j = 0;
-        for (uint32_t x = 0; x < config.gridWidth_px; x += config.cellWidth_px)
+        for (size_t j = 0; j < m_grid[i].size(); j++)
         {
-            SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255); // White
-            SDL_RenderDrawRect(renderer, &m_drawGrid[i][j]);
+            out.cellFullness[i * out.gridWidth + j] = m_grid[i][j].howFull();
+        }
+    }
 
-            // Draw filled inside of cell if not empty
-            if (!m_grid[i][j].isEmpty())
-            {
-                SDL_Rect fillRect;
-                SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255); // White
+    out.drainerPositions.resize(m_drainers.size(), GridPosition(0, 0));
+    for (size_t i = 0; i < m_drainers.size(); i++)
+    {
+        out.drainerPositions[i] = m_drainers[i].position();
+    }
+}
+
+bool Grid::isCellEmpty(uint8_t row, uint8_t col)
+{
+    return m_grid[row][col].isEmpty();
+}
+
+void Grid::save(GameState& out)
+{
+    out.rngState = m_rngState;
+    out.gridHeight = m_grid.size();
+    out.gridWidth = m_grid.empty() ? 0 : m_grid[0].size();
+
+    out.cells.resize(out.gridHeight * out.gridWidth);
+    for (size_t i = 0; i < m_grid.size(); i++)
+    {
+        for (size_t j = 0; j < m_grid[i].size(); j++)
+        {
+            out.cells[i * out.gridWidth + j] = m_grid[i][j].state();
+        }
+    }
+
+    out.availableCells = m_availableCells;
+}
+
+bool Grid::load(const GameState& in)
+{
+    size_t width = m_grid.empty() ? 0 : m_grid[0].size();
+    if (in.gridHeight != m_grid.size() || in.gridWidth != width || in.cells.size() != in.gridHeight * width)
+        return false;
+
+    for (const GridPosition& position : in.availableCells)
+    {
+        if (position.row < 0 || position.row >= in.gridHeight || position.col < 0 || position.col >= in.gridWidth)
+            return false;
+    }
+
+    for (size_t i = 0; i < m_grid.size(); i++)
+    {
+        for (size_t j = 0; j < width; j++)
+        {
+            m_grid[i][j].restore(in.cells[i * width + j]);
+        }
+    }
+
+    m_availableCells = in.availableCells;
+    m_rngState = in.rngState == 0 ? 0x9E3779B9 : in.rngState;
+    return true;
+}
+
+uint32_t Grid::nextRandom()
+{
+    // xorshift32, small enough to live in GameState
+    m_rngState ^= m_rngState << 13;
+    m_rngState ^= m_rngState >> 17;
+    m_rngState ^= m_rngState << 5;
+    return m_rngState;
+}
 
-                // Draw filled rectangle based on how much of cell is full 
-                float fullness = m_grid[i][j].howFull();
-                fillRect.w = config.cellWidth_px * fullness;
-                fillRect.h = config.cellHeight_px * fullness;
+////////////////////////////////
+// Game
+////////////////////////////////
+Game::Game(uint32_t seed, size_t numAgents)
+    : m_grid(config.gridWidth_cells, config.gridHeight_cells, m_drainers, seed),
+      m_agentScores(numAgents, 0),
+      m_seed(seed),
+      m_fillInterval_ms(config.fillInterval_ms),
+      m_drainRate(config.drainRate)
+{
+    assert(numAgents > 0);
 
-                // Shift filled rectangle half of the total missing proportion 
-                float shiftFactor = (1 - fullness) / 2;
-                fillRect.x = m_drawGrid[i][j].x + (shiftFactor * config.cellWidth_px);
-                fillRect.y = m_drawGrid[i][j].y + (shiftFactor * config.cellHeight_px);
+    // Spread agents across the grid row by row, agent 0 starts top left as before
+    size_t numCells = config.gridWidth_cells * config.gridHeight_cells;
+    m_drainers.reserve(numAgents);
+    for (size_t i = 0; i < numAgents; i++)
+    {
+        size_t cell = i % numCells;
+        m_drainers.emplace_back(cell / config.gridWidth_cells, cell % config.gridWidth_cells, config.gridWidth_cells, config.gridHeight_cells);
+    }
+}
 
-                SDL_RenderFillRect(renderer, &fillRect);
+void Game::apply(size_t agent, PlayerAction action)
+{
+    assert(agent < m_drainers.size());
+
+    switch (action)
+    {
+        case PlayerAction::MOVE_UP:
+            m_drainers[agent].move(PlayerMove::UP);
+            break;
+        case PlayerAction::MOVE_DOWN:
+            m_drainers[agent].move(PlayerMove::DOWN);
+            break;
+        case PlayerAction::MOVE_LEFT:
+            m_drainers[agent].move(PlayerMove::LEFT);
+            break;
+        case PlayerAction::MOVE_RIGHT:
+            m_drainers[agent].move(PlayerMove::RIGHT);
+            break;
+        case PlayerAction::REWIND:
+            break;
+        case PlayerAction::DRAIN:
+            m_pendingDrains.push_back({ agent, m_drainers[agent].position() });
+            break;
+    }
+}
+
+void Game::resolveDrains()
+{
+    if (m_pendingDrains.empty())
+        return;
+
+    // Rotate priority with the tick so contested cells go to each agent in turn.
+    // stable_sort keeps an agent's own drains in the order it sent them.
+    size_t numAgents = m_drainers.size();
+    size_t rotation = m_tick % numAgents;
+    auto priority = [&](const PendingDrain& drain)
+    {
+        return (drain.agent + numAgents - rotation) % numAgents;
+    };
+    std::stable_sort(m_pendingDrains.begin(), m_pendingDrains.end(), [&](const PendingDrain& a, const PendingDrain& b)
+    {
+        return priority(a) < priority(b);
+    });
+
+    // Forget drains too old to contest, they are in time order so the stale ones are at the front
+    size_t numStale = 0;
+    while (numStale < m_recentDrains.size() && m_totalTimeElapsed_ms - m_recentDrains[numStale].time_ms > CONTEST_WINDOW_MS)
+    {
+        numStale++;
+    }
+    m_recentDrains.erase(m_recentDrains.begin(), m_recentDrains.begin() + numStale);
+
+    // A drain of a cell that was just drained lost a contest rather than missed. Within
+    // this tick that applies to anyone, across ticks only to a different agent, so an
+    // agent draining the same cell twice still gets a strike.
+    for (const PendingDrain& drain : m_pendingDrains)
+    {
+        bool contested = false;
+        for (const RecentDrain& drained : m_recentDrains)
+        {
+            if (drained.position.row == drain.position.row && drained.position.col == drain.position.col
+                && (drained.time_ms == m_totalTimeElapsed_ms || drained.agent != drain.agent))
+            {
+                contested = true;
+                break;
             }
+        }
+
+        if (contested)
+            continue;
 
-            j++;
+        float score = 0.0f;
+        bool wasFull = m_grid.drainCell(drain.position.row, drain.position.col, score);
+        if (wasFull)
+        {
+            m_score += (int)score;
+            m_agentScores[drain.agent] += (int)score;
+            m_recentDrains.push_back({ drain.position, static_cast<uint32_t>(drain.agent), m_totalTimeElapsed_ms });
         }
-        i++;
+        else
+        {
+            m_strikes++;
+        }
+    }
+
+    m_pendingDrains.clear();
+}
+
+void Game::update(float dt)
+{
+    resolveDrains();
+
+    // Update fill frequency and rate
+    if (m_totalTimeElapsed_ms - m_lastFillPeriodUpdate_ms > config.fillIntervalDeltaPeriod_ms)
+    {
+        m_lastFillPeriodUpdate_ms = m_totalTimeElapsed_ms;
+        m_fillInterval_ms = std::max(config.fillIntervalMin_ms, m_fillInterval_ms - config.fillIntervalDelta_ms);
+    }
+
+    if (m_totalTimeElapsed_ms - m_lastDrainRatePeriodUpdate_ms > config.drainRateDeltaPeriod_ms)
+    {
+        m_lastDrainRatePeriodUpdate_ms = m_totalTimeElapsed_ms;
+        m_drainRate = std::min(config.drainRateMax, m_drainRate + config.drainRateDelta);
+    }
+
+    // If enough time has passed, fill a cell on the grid
+    if (m_totalTimeElapsed_ms - m_lastFillTime_ms > m_fillInterval_ms)
+    {
+        m_lastFillTime_ms = m_totalTimeElapsed_ms;
+        m_grid.fillCell(m_drainRate);
+    }
+
+    m_strikes += m_grid.update(dt);
+    m_totalTimeElapsed_ms += dt;
+    m_tick++;
+}
+
+void Game::snapshot(GameSnapshot& out)
+{
+    m_grid.snapshot(out);
+    out.agentScores = m_agentScores;
+    out.score = m_score;
+    out.strikes = m_strikes;
+    out.gameOver = isOver();
+}
+
+bool Game::isOver()
+{
+    return m_strikes >= MAX_STRIKES;
+}
+
+uint64_t Game::tick()
+{
+    return m_tick;
+}
+
+size_t Game::numAgents()
+{
+    return m_drainers.size();
+}
+
+uint32_t Game::seed()
+{
+    return m_seed;
+}
+
+bool Game::isPractice()
+{
+    return m_practice;
+}
+
+void Game::markPractice()
+{
+    m_practice = true;
+}
+
+void Game::save(GameState& out)
+{
+    m_grid.save(out);
+    out.tick = m_tick;
+    out.seed = m_seed;
+    out.practice = m_practice;
+    out.drainerPositions.resize(m_drainers.size(), GridPosition(0, 0));
+    for (size_t i = 0; i < m_drainers.size(); i++)
+    {
+        out.drainerPositions[i] = m_drainers[i].position();
+    }
+    out.agentScores = m_agentScores;
+    out.recentDrains = m_recentDrains;
+    out.score = m_score;
+    out.strikes = m_strikes;
+    out.totalTimeElapsed_ms = m_totalTimeElapsed_ms;
+    out.lastFillTime_ms = m_lastFillTime_ms;
+    out.lastFillPeriodUpdate_ms = m_lastFillPeriodUpdate_ms;
+    out.lastDrainRatePeriodUpdate_ms = m_lastDrainRatePeriodUpdate_ms;
+    out.fillInterval_ms = m_fillInterval_ms;
+    out.drainRate = m_drainRate;
+}
+
+bool Game::load(const GameState& in)
+{
+    if (in.drainerPositions.size() != m_drainers.size() || in.agentScores.size() != m_drainers.size())
+        return false;
+
+    for (const GridPosition& position : in.drainerPositions)
+    {
+        if (position.row < 0 || position.row >= in.gridHeight || position.col < 0 || position.col >= in.gridWidth)
+            return false;
+    }
+
+    if (!m_grid.load(in))
+        return false;
+
+    for (size_t i = 0; i < m_drainers.size(); i++)
+    {
+        m_drainers[i].setPosition(in.drainerPositions[i]);
+    }
+    m_pendingDrains.clear();
+    m_recentDrains = in.recentDrains;
+    m_agentScores = in.agentScores;
+    m_tick = in.tick;
+    m_seed = in.seed;
+    m_practice = in.practice;
+    m_score = in.score;
+    m_strikes = in.strikes;
+    m_totalTimeElapsed_ms = in.totalTimeElapsed_ms;
+    m_lastFillTime_ms = in.lastFillTime_ms;
+    m_lastFillPeriodUpdate_ms = in.lastFillPeriodUpdate_ms;
+    m_lastDrainRatePeriodUpdate_ms = in.lastDrainRatePeriodUpdate_ms;
+    m_fillInterval_ms = in.fillInterval_ms;
+    m_drainRate = in.drainRate;
+    return true;
+}
+
+////////////////////////////////
+// GameState
+////////////////////////////////
+static constexpr const uint32_t GAME_STATE_MAGIC = 0x4B524853; // "SHRK"
+static constexpr const uint16_t GAME_STATE_VERSION = 4;
+
+template <typename T>
+static void writeValue(std::vector<uint8_t>& out, const T& value)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+static bool readValue(const std::vector<uint8_t>& in, size_t& offset, T& value)
+{
+    if (in.size() - offset < sizeof(T))
+        return false;
+
+    std::memcpy(&value, in.data() + offset, sizeof(T));
+    offset += sizeof(T);
+    return true;
+}
+
+void GameState::serialize(std::vector<uint8_t>& out) const
+{
+    // Native byte order, saves are not meant to move between machines
+    out.clear();
+    writeValue(out, GAME_STATE_MAGIC);
+    writeValue(out, GAME_STATE_VERSION);
+    writeValue(out, tick);
+    writeValue(out, seed);
+    writeValue(out, rngState);
+    writeValue(out, static_cast<uint8_t>(practice));
+    writeValue(out, static_cast<uint32_t>(drainerPositions.size()));
+    for (size_t i = 0; i < drainerPositions.size(); i++)
+    {
+        writeValue(out, drainerPositions[i].row);
+        writeValue(out, drainerPositions[i].col);
+        writeValue(out, i < agentScores.size() ? agentScores[i] : int64_t(0));
     }
+    writeValue(out, score);
+    writeValue(out, strikes);
+    writeValue(out, totalTimeElapsed_ms);
+    writeValue(out, lastFillTime_ms);
+    writeValue(out, lastFillPeriodUpdate_ms);
+    writeValue(out, lastDrainRatePeriodUpdate_ms);
+    writeValue(out, fillInterval_ms);
+    writeValue(out, drainRate);
+    writeValue(out, gridWidth);
+    writeValue(out, gridHeight);
 
-    // Draw larger blue outline for current drainer position
-    GridPosition drainerPos = m_drainer.position();
-    SDL_Rect r = m_drawGrid[drainerPos.row][drainerPos.col];
+    for (const CellState& cell : cells)
+    {
+        writeValue(out, cell.proportionFilled);
+        writeValue(out, cell.shrinkRate);
+    }
 
-    // SDL_gfx function to be able to draw thicker lines 
-    thickLineRGBA(renderer, r.x, r.y, r.x + r.w, r.y, lineThickness, 51, 153, 255, 255); // Top of square
-    thickLineRGBA(renderer, r.x + r.w, r.y, r.x + r.w, r.y + r.h, lineThickness, 51, 153, 255, 255); // Right of square
-    thickLineRGBA(renderer, r.x, r.y + r.h, r.x + r.w, r.y + r.h, lineThickness, 51, 153, 255, 255); // Bottom of square
-    thickLineRGBA(renderer, r.x, r.y, r.x, r.y + r.h, lineThickness, 51, 153, 255, 255); // Left of square 
+    writeValue(out, static_cast<uint16_t>(availableCells.size()));
+    for (const GridPosition& position : availableCells)
+    {
+        writeValue(out, position.row);
+        writeValue(out, position.col);
+    }
 
-}
\ No newline at end of file
+    writeValue(out, static_cast<uint32_t>(recentDrains.size()));
+    for (const RecentDrain& drain : recentDrains)
+    {
+        writeValue(out, drain.position.row);
+        writeValue(out, drain.position.col);
+        writeValue(out, drain.agent);
+        writeValue(out, drain.time_ms);
+    }
+}
+
+bool GameState::deserialize(const std::vector<uint8_t>& in)
+{
+    size_t offset = 0;
+    uint32_t magic = 0;
+    uint16_t version = 0;
+    if (!readValue(in, offset, magic) || magic != GAME_STATE_MAGIC)
+        return false;
+    if (!readValue(in, offset, version) || version != GAME_STATE_VERSION)
+        return false;
+
+    uint8_t practiceByte = 0;
+    bool ok = readValue(in, offset, tick)
+        && readValue(in, offset, seed)
+        && readValue(in, offset, rngState)
+        && readValue(in, offset, practiceByte);
+    if (!ok)
+        return false;
+    practice = practiceByte != 0;
+
+    uint32_t numAgents = 0;
+    if (!readValue(in, offset, numAgents) || numAgents > in.size())
+        return false;
+
+    drainerPositions.clear();
+    agentScores.resize(numAgents);
+    for (uint32_t i = 0; i < numAgents; i++)
+    {
+        int8_t row, col;
+        if (!readValue(in, offset, row) || !readValue(in, offset, col) || row < 0 || col < 0)
+            return false;
+        drainerPositions.push_back(GridPosition(row, col));
+
+        if (!readValue(in, offset, agentScores[i]))
+            return false;
+    }
+
+    ok = readValue(in, offset, score)
+        && readValue(in, offset, strikes)
+        && readValue(in, offset, totalTimeElapsed_ms)
+        && readValue(in, offset, lastFillTime_ms)
+        && readValue(in, offset, lastFillPeriodUpdate_ms)
+        && readValue(in, offset, lastDrainRatePeriodUpdate_ms)
+        && readValue(in, offset, fillInterval_ms)
+        && readValue(in, offset, drainRate)
+        && readValue(in, offset, gridWidth)
+        && readValue(in, offset, gridHeight);
+    if (!ok)
+        return false;
+
+    cells.resize(gridWidth * gridHeight);
+    for (CellState& cell : cells)
+    {
+        if (!readValue(in, offset, cell.proportionFilled) || !readValue(in, offset, cell.shrinkRate))
+            return false;
+    }
+
+    uint16_t numAvailable = 0;
+    if (!readValue(in, offset, numAvailable))
+        return false;
+
+    availableCells.clear();
+    for (uint16_t i = 0; i < numAvailable; i++)
+    {
+        int8_t row, col;
+        if (!readValue(in, offset, row) || !readValue(in, offset, col) || row < 0 || col < 0)
+            return false;
+        availableCells.push_back(GridPosition(row, col));
+    }
+
+    uint32_t numRecent = 0;
+    if (!readValue(in, offset, numRecent) || numRecent > in.size())
+        return false;
+
+    recentDrains.clear();
+    for (uint32_t i = 0; i < numRecent; i++)
+    {
+        int8_t row, col;
+        uint32_t agent;
+        float time_ms;
+        if (!readValue(in, offset, row) || !readValue(in, offset, col) || row < 0 || col < 0
+            || !readValue(in, offset, agent) || !readValue(in, offset, time_ms))
+            return false;
+        recentDrains.push_back({ GridPosition(row, col), agent, time_ms });
+    }
+
+    return offset == in.size();
+}
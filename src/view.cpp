@@ -0,0 +1,83 @@
+#include "view.h"
+
+////////////////////////////////
+// GridView : IDrawable
+////////////////////////////////
+GridView::GridView(uint8_t width, uint8_t height)
+{
+    for (int i = 0; i < height; i++)
+    {
+        for (int j = 0; j < width; j++)
+        {
+            // Intialize known pixel positions of cells
+            SDL_Rect rect = SDL_Rect();
+            rect.h = config.cellHeight_px;
+            rect.w = config.cellWidth_px;
+            rect.x = config.gridOriginX_px + (j * config.cellWidth_px);
+            rect.y = config.gridOriginY_px + (i * config.cellHeight_px);
+            m_cellRects.push_back(rect);
+        }
+    }
+}
+
+void GridView::setSnapshot(const GameSnapshot* snapshot)
+{
+    m_snapshot = snapshot;
+}
+
+void GridView::draw(SDL_Renderer* renderer)
+{
+    // Draw all cells based on their fullness
+    // Drainer position cells should be outlined in color
+    if (m_snapshot == nullptr || m_snapshot->cellFullness.size() != m_cellRects.size())
+        return;
+
+    // Outlines are thinner on big grids so neighbouring highlights do not swallow the cells
+    int lineThickness = std::max(1, std::min(8, (int)std::min(config.cellWidth_px, config.cellHeight_px) / 18));
+
+    m_fillRects.clear();
+    for (size_t i = 0; i < m_cellRects.size(); i++)
+    {
+        float fullness = m_snapshot->cellFullness[i];
+        if (fullness > 0.0f)
+        {
+            // Filled rectangle based on how much of cell is full,
+            // shifted half of the total missing proportion
+            SDL_Rect fillRect;
+            float shiftFactor = (1 - fullness) / 2;
+            fillRect.w = config.cellWidth_px * fullness;
+            fillRect.h = config.cellHeight_px * fullness;
+            fillRect.x = m_cellRects[i].x + (shiftFactor * config.cellWidth_px);
+            fillRect.y = m_cellRects[i].y + (shiftFactor * config.cellHeight_px);
+            m_fillRects.push_back(fillRect);
+        }
+    }
+
+    m_playerHighlightRects.clear();
+    m_botHighlightRects.clear();
+    for (size_t agent = 0; agent < m_snapshot->drainerPositions.size(); agent++)
+    {
+        addHighlight(agent == 0 ? m_playerHighlightRects : m_botHighlightRects, m_snapshot->drainerPositions[agent], lineThickness);
+    }
+
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255); // White
+    SDL_RenderDrawRects(renderer, m_cellRects.data(), m_cellRects.size());
+    SDL_RenderFillRects(renderer, m_fillRects.data(), m_fillRects.size());
+
+    // Bots in orange underneath the local player's blue
+    SDL_SetRenderDrawColor(renderer, 255, 153, 51, 255);
+    SDL_RenderFillRects(renderer, m_botHighlightRects.data(), m_botHighlightRects.size());
+    SDL_SetRenderDrawColor(renderer, 51, 153, 255, 255);
+    SDL_RenderFillRects(renderer, m_playerHighlightRects.data(), m_playerHighlightRects.size());
+}
+
+void GridView::addHighlight(std::vector<SDL_Rect>& out, GridPosition position, int lineThickness)
+{
+    // Four thick edges centered on the cell border, as filled rects so they batch
+    const SDL_Rect& r = m_cellRects[position.row * m_snapshot->gridWidth + position.col];
+    int half = lineThickness / 2;
+    out.push_back({ r.x - half, r.y - half, r.w + lineThickness, lineThickness }); // Top of square
+    out.push_back({ r.x + r.w - half, r.y - half, lineThickness, r.h + lineThickness }); // Right of square
+    out.push_back({ r.x - half, r.y + r.h - half, r.w + lineThickness, lineThickness }); // Bottom of square
+    out.push_back({ r.x - half, r.y - half, lineThickness, r.h + lineThickness }); // Left of square
+}
@@ -0,0 +1,120 @@
+/*
+ * shrinky-leaderboard: inspects and compacts the leaderboard file the game
+ * writes finished sessions to.
+ */
+#include "leaderboard.h"
+
+#include <cstdlib>
+#include <ctime>
+
+static std::string defaultLeaderboardPath()
+{
+    // Same place SDL_GetPrefPath("lanbas", "shrinky") points the game at on Linux
+    const char* dataHome = std::getenv("XDG_DATA_HOME");
+    if (dataHome != nullptr && dataHome[0] != '\0')
+        return std::string(dataHome) + "/lanbas/shrinky/leaderboard.dat";
+
+    const char* home = std::getenv("HOME");
+    return std::string(home != nullptr ? home : ".") + "/.local/share/lanbas/shrinky/leaderboard.dat";
+}
+
+static void printUsage()
+{
+    std::cout << "Usage: shrinky-leaderboard [--file PATH] COMMAND" << std::endl
+        << "  top [N]              best N sessions (default 10)" << std::endl
+        << "  stats                per-config aggregates" << std::endl
+        << "  compact [--keep N]   rewrite the file keeping the top sessions and the newest N (default 10000)" << std::endl;
+}
+
+static void printTop(Leaderboard& leaderboard, size_t count)
+{
+    for (size_t rank = 0; rank < std::min(count, leaderboard.topCount()); rank++)
+    {
+        const SessionRecord& record = leaderboard.record(leaderboard.top(rank).record);
+        std::time_t finishedAt = record.finishedAt;
+        char date[32];
+        std::strftime(date, sizeof(date), "%Y-%m-%d %H:%M", std::localtime(&finishedAt));
+
+        std::cout << rank + 1 << ". " << record.score
+            << "  " << record.duration_ms / 1000 << "s"
+            << "  config " << std::hex << record.configHash << std::dec
+            << "  seed " << record.seed
+            << "  " << date << std::endl;
+    }
+}
+
+static void printStats(Leaderboard& leaderboard)
+{
+    std::cout << leaderboard.size() << " sessions on file" << std::endl;
+    for (size_t i = 0; i < leaderboard.aggregateCount(); i++)
+    {
+        const ConfigAggregate& aggregate = leaderboard.aggregateAt(i);
+        std::cout << "config " << std::hex << aggregate.configHash << std::dec
+            << "  sessions " << aggregate.sessions
+            << "  best " << aggregate.bestScore
+            << "  mean " << aggregate.totalScore / (double)aggregate.sessions
+            << "  mean duration " << aggregate.totalDuration_ms / 1000.0 / aggregate.sessions << "s"
+            << "  mean strikes " << aggregate.totalStrikes / (double)aggregate.sessions << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string path = defaultLeaderboardPath();
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--file" && i + 1 < argc)
+            path = argv[++i];
+        else
+            args.push_back(arg);
+    }
+
+    if (args.empty())
+    {
+        printUsage();
+        return 1;
+    }
+
+    Leaderboard leaderboard;
+    auto start = std::chrono::steady_clock::now();
+    if (!leaderboard.open(path))
+    {
+        std::cerr << "Cannot open " << path << std::endl;
+        return 1;
+    }
+    auto openTime_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    if (args[0] == "top")
+    {
+        size_t count = args.size() > 1 ? std::strtoul(args[1].c_str(), nullptr, 10) : 10;
+        std::cout << leaderboard.size() << " sessions, opened in " << openTime_us << " us" << std::endl;
+        printTop(leaderboard, count);
+    }
+    else if (args[0] == "stats")
+    {
+        printStats(leaderboard);
+    }
+    else if (args[0] == "compact")
+    {
+        size_t keep = 10000;
+        if (args.size() > 2 && args[1] == "--keep")
+            keep = std::strtoul(args[2].c_str(), nullptr, 10);
+
+        size_t before = leaderboard.size();
+        if (!leaderboard.compact(keep))
+        {
+            std::cerr << "Compaction failed" << std::endl;
+            return 1;
+        }
+        std::cout << "Compacted " << before << " sessions to " << leaderboard.size() << std::endl;
+    }
+    else
+    {
+        printUsage();
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,31 @@
+#!/bin/sh
+# Packs the given asset files into a C++ source file defining g_assets, the
+# table that findAsset()/openAsset() in src/assets.cpp search. Paths are stored
+# exactly as passed in, so call this from the repository root.
+set -e
+
+symbolFor()
+{
+    echo "asset_$1" | sed 's/[^A-Za-z0-9]/_/g'
+}
+
+echo "// Generated by tools/pack_assets.sh, do not edit"
+echo "#include \"assets.h\""
+echo
+
+for file in "$@"
+do
+    echo "alignas(16) static const unsigned char $(symbolFor "$file")[] = {"
+    xxd -i < "$file"
+    echo "};"
+    echo
+done
+
+echo "const Asset g_assets[] = {"
+for file in "$@"
+do
+    symbol=$(symbolFor "$file")
+    echo "    { \"$file\", $symbol, sizeof($symbol) },"
+done
+echo "};"
+echo "const size_t g_numAssets = sizeof(g_assets) / sizeof(g_assets[0]);"